@@ -0,0 +1,444 @@
+/** @author Mateusz Machalica */
+
+/* Benchmark of pipeline stages and backends on generated graphs, see README.
+ * Built like OPTIMIZE=1, stage timings are collected from MICROPROF output. */
+#define NDEBUG
+#define MICROPROF_ENABLE
+#define MYCL_ERROR_CHECKING
+
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <string>
+#include <random>
+#include <thread>
+#include <future>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/* Redirected to a memory buffer for the duration of each run. */
+static FILE* bench_profile_stream = stdout;
+#define MICROPROF_STREAM bench_profile_stream
+
+#include "./BrandesKadabra.h"
+
+#ifndef DEFAULT_MDEG
+#define DEFAULT_MDEG 8
+#endif
+
+#ifndef DEFAULT_WGROUP
+#define DEFAULT_WGROUP 192
+#endif
+
+using namespace brandes;  // NOLINT(build/namespaces)
+
+typedef csr_create<ocsr_create<statistics<deg1_reduce<cpu_driver<
+  vcsr_create<betweenness>>>>>> FullPipe;
+typedef csr_create<ocsr_create<no_stats<deg1_pass<cpu_driver<
+  vcsr_create<betweenness>>>>>> NoDeg1Pipe;
+typedef csr_create<ocsr_pass<no_stats<deg1_pass<cpu_driver<
+  vcsr_create<betweenness>>>>>> NoOrderPipe;
+typedef wcsr_create<ocsr_create<no_stats<deg1_reduce<cpu_driver<
+  vcsr_create<betweenness>>>>>> WeightedPipe;
+
+struct Graph {
+  std::string name_;
+  int n_;
+  std::vector<Edge> edges_;
+  std::vector<WeightedEdge> wedges_;
+};
+
+struct Backend {
+  std::string name_;
+  int jobs_;
+  bool gpu_;
+  int team_min_n_;
+};
+
+struct Run {
+  std::string graph_;
+  std::string config_;
+  double total_ms_;
+  double teps_;
+  double max_rel_diff_;
+  std::map<std::string, double> stages_;
+};
+
+/* Drops loops and duplicates, assigns lengths 1..10 for weighted runs. */
+static Graph make_graph(
+    const std::string& name,
+    int n,
+    std::vector<std::pair<int, int>> pairs,
+    std::mt19937* gen
+    ) {
+  for (auto& p : pairs) {
+    if (p.first > p.second) {
+      std::swap(p.first, p.second);
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+  std::uniform_int_distribution<int> length(1, 10);
+  Graph g;
+  g.name_ = name;
+  g.n_ = n;
+  for (auto& p : pairs) {
+    if (p.first != p.second) {
+      g.edges_.push_back(Edge{p.first, p.second});
+      g.wedges_.push_back(WeightedEdge{p.first, p.second,
+          static_cast<WeightedEdge::Length>(length(*gen))});
+    }
+  }
+  return g;
+}
+
+/* Recursive matrix with the Graph500 parameters. */
+static Graph rmat(int scale, std::mt19937* gen) {
+  const int n = 1 << scale;
+  const double a = 0.57, b = 0.19, c = 0.19;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < 8 * n; i++) {
+    int u = 0, v = 0;
+    for (int bit = 0; bit < scale; bit++) {
+      const double r = uniform(*gen);
+      u = 2 * u + (r >= a + b);
+      v = 2 * v + (r >= a && (r < a + b || r >= a + b + c));
+    }
+    pairs.push_back(std::make_pair(u, v));
+  }
+  return make_graph("rmat", n, pairs, gen);
+}
+
+/* Preferential attachment, four edges per new vertex. */
+static Graph barabasi_albert(int n, std::mt19937* gen) {
+  const int k = 4;
+  std::vector<int> ends;
+  std::vector<std::pair<int, int>> pairs;
+  for (int v = 1; v <= k; v++) {
+    pairs.push_back(std::make_pair(0, v));
+    ends.push_back(0);
+    ends.push_back(v);
+  }
+  for (int v = k + 1; v < n; v++) {
+    for (int i = 0; i < k; i++) {
+      std::uniform_int_distribution<size_t> pick(0, ends.size() - 1);
+      const int u = ends[pick(*gen)];
+      pairs.push_back(std::make_pair(u, v));
+    }
+    for (int i = 0; i < k; i++) {
+      ends.push_back(pairs[pairs.size() - 1 - i].first);
+      ends.push_back(v);
+    }
+  }
+  return make_graph("ba", n, pairs, gen);
+}
+
+static Graph grid(int n, std::mt19937* gen) {
+  const int side = std::max(2, static_cast<int>(std::sqrt(n)));
+  std::vector<std::pair<int, int>> pairs;
+  for (int r = 0; r < side; r++) {
+    for (int c = 0; c < side; c++) {
+      if (c + 1 < side) {
+        pairs.push_back(std::make_pair(r * side + c, r * side + c + 1));
+      }
+      if (r + 1 < side) {
+        pairs.push_back(std::make_pair(r * side + c, (r + 1) * side + c));
+      }
+    }
+  }
+  return make_graph("grid", side * side, pairs, gen);
+}
+
+/* Long chains of degree two vertices joined by sparse crossings. */
+static Graph road(int n, std::mt19937* gen) {
+  const int chains = std::max(2, static_cast<int>(std::sqrt(n)) / 2);
+  const int length = n / chains;
+  std::vector<std::pair<int, int>> pairs;
+  for (int c = 0; c < chains; c++) {
+    for (int i = 0; i + 1 < length; i++) {
+      pairs.push_back(std::make_pair(c * length + i, c * length + i + 1));
+    }
+  }
+  std::uniform_int_distribution<int> vertex(0, chains * length - 1);
+  for (int i = 0; i < 2 * chains; i++) {
+    pairs.push_back(std::make_pair(vertex(*gen), vertex(*gen)));
+  }
+  for (int c = 0; c + 1 < chains; c++) {
+    pairs.push_back(std::make_pair(c * length, (c + 1) * length));
+  }
+  return make_graph("road", chains * length, pairs, gen);
+}
+
+/* Random trees of up to 64 vertices. */
+static Graph forest(int n, std::mt19937* gen) {
+  std::vector<std::pair<int, int>> pairs;
+  for (int root = 0; root < n; root += 64) {
+    for (int v = root + 1; v < std::min(root + 64, n); v++) {
+      std::uniform_int_distribution<int> parent(root, v - 1);
+      pairs.push_back(std::make_pair(parent(*gen), v));
+    }
+  }
+  return make_graph("forest", n, pairs, gen);
+}
+
+/* Sums "PROFILING:\tname\tms" lines, stages may be reported many times. */
+static std::map<std::string, double> parse_stages(const char* log) {
+  std::map<std::string, double> stages;
+  const char* line = log;
+  while (line && *line) {
+    char name[128];
+    double ms;
+    if (sscanf(line, "PROFILING:\t%127s\t%lf", name, &ms) == 2) {
+      stages[name] += ms;
+    }
+    line = strchr(line, '\n');
+    line = line ? line + 1 : nullptr;
+  }
+  return stages;
+}
+
+template<typename Pipe, typename EdgeType>
+static Run run(
+    const Graph& g,
+    const std::vector<EdgeType>& E,
+    const std::string& pipe,
+    const Backend& backend,
+    int repeat,
+    std::vector<float>* reference
+    ) {
+  Run best;
+  best.graph_ = g.name_;
+  best.config_ = pipe + "/" + backend.name_;
+  best.total_ms_ = -1;
+  /* Every repeat is checked against the reference, not only the fastest. */
+  best.max_rel_diff_ = 0;
+  for (int r = 0; r < repeat; r++) {
+    char* log = nullptr;
+    size_t log_size = 0;
+    bench_profile_stream = open_memstream(&log, &log_size);
+    Context ctx(backend.gpu_
+        ? std::async(std::launch::async, mycl::init_device)
+        : std::async(std::launch::deferred, mycl::init_device),
+        DEFAULT_MDEG, DEFAULT_WGROUP, backend.jobs_, backend.gpu_, 0,
+        backend.team_min_n_);
+    MICROBENCH_TIMEPOINT(start);
+    auto bc = Pipe().template cont<std::vector<float>>(ctx, g.n_, E);
+    MICROBENCH_TIMEPOINT(end);
+    fclose(bench_profile_stream);
+    bench_profile_stream = stdout;
+    const double ms = MicroProfUnits(end - start).count();
+    if (best.total_ms_ < 0 || ms < best.total_ms_) {
+      best.total_ms_ = ms;
+      best.stages_ = parse_stages(log);
+    }
+    free(log);
+    if (reference->empty()) {
+      *reference = bc;
+    }
+    for (size_t v = 0; v < bc.size(); v++) {
+      best.max_rel_diff_ = std::max<double>(best.max_rel_diff_,
+          std::fabs(bc[v] - (*reference)[v]) /
+          std::max(1.0f, std::fabs((*reference)[v])));
+    }
+  }
+  /* Graph500 convention: every source traverses every edge once. */
+  best.teps_ = static_cast<double>(g.n_) * E.size() / (best.total_ms_ / 1000);
+  fprintf(stderr, "%s\t%s\t%.3f ms\n", best.graph_.c_str(),
+      best.config_.c_str(), best.total_ms_);
+  return best;
+}
+
+static void write_json(
+    FILE* fp,
+    const std::vector<Run>& runs,
+    const std::vector<std::string>& regressions
+    ) {
+  fprintf(fp, "{\n  \"runs\": [");
+  for (size_t i = 0; i < runs.size(); i++) {
+    const Run& r = runs[i];
+    fprintf(fp, "%s\n    {\"graph\": \"%s\", \"config\": \"%s\", "
+        "\"total_ms\": %.3f, \"teps\": %.0f, \"max_rel_diff\": %g, "
+        "\"stages\": {", i ? "," : "", r.graph_.c_str(), r.config_.c_str(),
+        r.total_ms_, r.teps_, r.max_rel_diff_);
+    bool first = true;
+    for (auto& stage : r.stages_) {
+      fprintf(fp, "%s\"%s\": %.3f", first ? "" : ", ", stage.first.c_str(),
+          stage.second);
+      first = false;
+    }
+    fprintf(fp, "}}");
+  }
+  fprintf(fp, "\n  ],\n  \"regressions\": [");
+  for (size_t i = 0; i < regressions.size(); i++) {
+    fprintf(fp, "%s\n    \"%s\"", i ? "," : "", regressions[i].c_str());
+  }
+  fprintf(fp, "%s]\n}\n", regressions.empty() ? "" : "\n  ");
+}
+
+/* Compares total times with runs of the same graph and configuration. */
+static std::vector<std::string> check_baseline(
+    const std::vector<Run>& runs,
+    const char* baseline_path,
+    double tolerance
+    ) {
+  std::vector<std::string> regressions;
+  for (auto& r : runs) {
+    if (r.max_rel_diff_ > 1e-3) {
+      regressions.push_back(r.graph_ + " " + r.config_ +
+          ": scores differ from the first configuration");
+    }
+  }
+  if (!baseline_path) {
+    return regressions;
+  }
+  boost::property_tree::ptree baseline;
+  boost::property_tree::read_json(baseline_path, baseline);
+  std::map<std::string, double> base_ms;
+  for (auto& item : baseline.get_child("runs")) {
+    base_ms[item.second.get<std::string>("graph") + " " +
+      item.second.get<std::string>("config")] =
+      item.second.get<double>("total_ms");
+  }
+  for (auto& r : runs) {
+    auto it = base_ms.find(r.graph_ + " " + r.config_);
+    if (it != base_ms.end() && r.total_ms_ > it->second * (1 + tolerance)) {
+      char msg[256];
+      snprintf(msg, sizeof(msg), "%s %s: %.3f ms, baseline %.3f ms",
+          r.graph_.c_str(), r.config_.c_str(), r.total_ms_, it->second);
+      regressions.push_back(msg);
+    }
+  }
+  return regressions;
+}
+
+static void usage() {
+  fprintf(stderr,
+      "Usage: brandes-bench [options]\n"
+      "  --scale s        graphs of about 2^s vertices (default 12)\n"
+      "  --graphs list    comma separated subset of rmat,ba,grid,road,forest\n"
+      "  --seed x         generator seed (default 1)\n"
+      "  --repeat r       best of r runs (default 3)\n"
+      "  --jobs j         CPU jobs of parallel configurations\n"
+      "  --gpu            include GPU configurations\n"
+      "  --baseline f     JSON output of an earlier run to compare with\n"
+      "  --tolerance t    allowed relative slowdown (default 0.1)\n"
+      "  --output f       write JSON to f instead of stdout\n");
+  exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+  using boost::lexical_cast;
+  int scale = 12, repeat = 3;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  unsigned seed = 1;
+  bool use_gpu = false;
+  std::string graphs = "rmat,ba,grid,road,forest";
+  const char* baseline_path = nullptr;
+  const char* output_path = nullptr;
+  double tolerance = 0.1;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--gpu") {
+      use_gpu = true;
+    } else if (i + 1 >= argc) {
+      usage();
+    } else if (arg == "--scale") {
+      scale = lexical_cast<int>(argv[++i]);
+    } else if (arg == "--graphs") {
+      graphs = argv[++i];
+    } else if (arg == "--seed") {
+      seed = lexical_cast<unsigned>(argv[++i]);
+    } else if (arg == "--repeat") {
+      repeat = lexical_cast<int>(argv[++i]);
+    } else if (arg == "--jobs") {
+      jobs = lexical_cast<int>(argv[++i]);
+    } else if (arg == "--baseline") {
+      baseline_path = argv[++i];
+    } else if (arg == "--tolerance") {
+      tolerance = lexical_cast<double>(argv[++i]);
+    } else if (arg == "--output") {
+      output_path = argv[++i];
+    } else {
+      usage();
+    }
+  }
+
+  std::vector<Backend> backends = {
+    {"cpu1", 1, false, 1 << 30},
+  };
+  std::vector<Backend> weighted_backends = {
+    {"dijkstra1", 1, false, 1 << 30},
+    {"team" + std::to_string(std::max(jobs, 2)), std::max(jobs, 2), false, 0},
+  };
+  if (jobs > 1) {
+    backends.push_back({"cpu" + std::to_string(jobs), jobs, false, 1 << 30});
+    weighted_backends.push_back({"dijkstra" + std::to_string(jobs), jobs,
+        false, 1 << 30});
+  }
+  if (use_gpu) {
+    backends.push_back({"gpu", 0, true, 1 << 30});
+    backends.push_back({"gpu+cpu" + std::to_string(jobs), jobs, true,
+        1 << 30});
+  }
+
+  std::vector<Run> runs;
+  std::mt19937 gen(seed);
+  const int n = 1 << scale;
+  std::string list = graphs + ",";
+  for (size_t start = 0, end; (end = list.find(',', start)) !=
+      std::string::npos; start = end + 1) {
+    const std::string name = list.substr(start, end - start);
+    Graph g;
+    if (name == "rmat") {
+      g = rmat(scale, &gen);
+    } else if (name == "ba") {
+      g = barabasi_albert(n, &gen);
+    } else if (name == "grid") {
+      g = grid(n, &gen);
+    } else if (name == "road") {
+      g = road(n, &gen);
+    } else if (name == "forest") {
+      g = forest(n, &gen);
+    } else {
+      if (!name.empty()) {
+        fprintf(stderr, "Unknown graph %s.\n", name.c_str());
+      }
+      continue;
+    }
+    std::vector<float> reference, wreference;
+    for (auto& b : backends) {
+      runs.push_back(run<FullPipe>(g, g.edges_, "full", b, repeat,
+            &reference));
+      runs.push_back(run<NoDeg1Pipe>(g, g.edges_, "no_deg1", b, repeat,
+            &reference));
+      runs.push_back(run<NoOrderPipe>(g, g.edges_, "no_order", b, repeat,
+            &reference));
+    }
+    for (auto& b : weighted_backends) {
+      runs.push_back(run<WeightedPipe>(g, g.wedges_, "weighted", b, repeat,
+            &wreference));
+    }
+  }
+
+  auto regressions = check_baseline(runs, baseline_path, tolerance);
+  FILE* fp = output_path ? fopen(output_path, "w") : stdout;
+  if (!fp) {
+    fprintf(stderr, "Cannot write %s\n", output_path);
+    return 1;
+  }
+  write_json(fp, runs, regressions);
+  if (output_path) {
+    fclose(fp);
+  }
+  for (auto& msg : regressions) {
+    fprintf(stderr, "REGRESSION:\t%s\n", msg.c_str());
+  }
+  return regressions.empty() ? 0 : 2;
+}
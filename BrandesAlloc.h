@@ -0,0 +1,166 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESALLOC_H_
+#define BRANDESALLOC_H_
+
+#include <sys/mman.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <new>
+#include <utility>
+
+#include "./MicroBench.h"
+
+namespace brandes {
+
+  /** Mappings for buffers of at least one huge page. Explicit huge pages are
+   * used while the system has free ones (of the default 2MB size), others
+   * are aligned to huge page boundaries and marked for transparent huge
+   * pages. Smaller buffers come from the heap. Mappings are zero-filled by
+   * the kernel on first touch, page by page. */
+  class HugePages {
+    public:
+      static const size_t kPageSize = 2 << 20;
+
+      static inline void* allocate(const size_t bytes) {
+#ifndef NO_HUGE_PAGES
+        if (bytes >= kPageSize) {
+          const size_t len = round_up(bytes);
+          void* addr = explicit_pages() ? mmap(nullptr, len,
+              PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+              -1, 0) : MAP_FAILED;
+          if (addr == MAP_FAILED) {
+            addr = map_aligned(len);
+          }
+          if (addr == MAP_FAILED) {
+            throw std::bad_alloc();
+          }
+          return addr;
+        }
+#endif  // NO_HUGE_PAGES
+        return ::operator new(bytes);
+      }
+
+      static inline void deallocate(void* addr, const size_t bytes) {
+#ifndef NO_HUGE_PAGES
+        if (bytes >= kPageSize) {
+          munmap(addr, round_up(bytes));
+          return;
+        }
+#else
+        SUPPRESS_UNUSED(bytes);
+#endif  // NO_HUGE_PAGES
+        ::operator delete(addr);
+      }
+
+    private:
+      static inline size_t round_up(const size_t bytes) {
+        return (bytes + kPageSize - 1) / kPageSize * kPageSize;
+      }
+
+      /* Maps one page more than needed and trims both ends to the nearest
+       * huge page boundary. */
+      static inline void* map_aligned(const size_t len) {
+        void* addr = mmap(nullptr, len + kPageSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+          return addr;
+        }
+        char* raw = static_cast<char*>(addr);
+        char* aligned = raw + (kPageSize - reinterpret_cast<uintptr_t>(raw) %
+            kPageSize) % kPageSize;
+        if (aligned != raw) {
+          munmap(raw, aligned - raw);
+        }
+        munmap(aligned + len, raw + len + kPageSize - aligned - len);
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, len, MADV_HUGEPAGE);
+#endif  // MADV_HUGEPAGE
+        return aligned;
+      }
+
+      /* Read once, a failed mapping falls back to transparent pages. */
+      static inline bool explicit_pages() {
+        static const bool available = [] {
+          FILE* fp = fopen("/proc/meminfo", "r");
+          if (!fp) {
+            return false;
+          }
+          long long free_pages = 0, page_kbytes = 0;
+          char line[256];
+          while (fgets(line, sizeof(line), fp)) {
+            sscanf(line, "HugePages_Free: %lld", &free_pages);
+            sscanf(line, "Hugepagesize: %lld", &page_kbytes);
+          }
+          fclose(fp);
+          return free_pages > 0 &&
+            static_cast<size_t>(page_kbytes) * 1024 == kPageSize;
+        }();
+        return available;
+      }
+  };
+
+  /** Allocates through HugePages. Unless kInit, elements constructed
+   * without arguments are default-initialized, so that resizing a vector of
+   * scalars leaves them unset. */
+  template<typename T, bool kInit = true> class HugePageAllocator {
+    public:
+      typedef T value_type;
+
+      template<typename U> struct rebind {
+        typedef HugePageAllocator<U, kInit> other;
+      };
+
+      HugePageAllocator() noexcept {}
+
+      template<typename U>
+        HugePageAllocator(const HugePageAllocator<U, kInit>&) noexcept {}
+
+      inline T* allocate(const size_t n) {
+        return static_cast<T*>(HugePages::allocate(n * sizeof(T)));
+      }
+
+      inline void deallocate(T* addr, const size_t n) noexcept {
+        HugePages::deallocate(addr, n * sizeof(T));
+      }
+
+      template<typename U> inline void construct(U* addr) {
+        if (kInit) {
+          ::new(static_cast<void*>(addr)) U();
+        } else {
+          ::new(static_cast<void*>(addr)) U;
+        }
+      }
+
+      template<typename U, typename... Args>
+        inline void construct(U* addr, Args&&... args) {
+          ::new(static_cast<void*>(addr)) U(std::forward<Args>(args)...);
+        }
+  };
+
+  template<typename T, typename U, bool kInit>
+    inline bool operator==(const HugePageAllocator<T, kInit>&,
+        const HugePageAllocator<U, kInit>&) {
+      return true;
+    }
+
+  template<typename T, typename U, bool kInit>
+    inline bool operator!=(const HugePageAllocator<T, kInit>&,
+        const HugePageAllocator<U, kInit>&) {
+      return false;
+    }
+
+  /** Vector on huge pages, initialized as std::vector. */
+  template<typename T> using HugeVector =
+    std::vector<T, HugePageAllocator<T>>;
+
+  /** Vector on huge pages for buffers written before they are read, sizing
+   * it leaves scalars uninitialized (filling constructors and assign() still
+   * fill). */
+  template<typename T> using RawVector =
+    std::vector<T, HugePageAllocator<T, false>>;
+
+}  // namespace brandes
+
+#endif  // BRANDESALLOC_H_
@@ -0,0 +1,158 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESBATCH_H_
+#define BRANDESBATCH_H_
+
+#include <cassert>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "./BrandesKadabra.h"
+
+namespace brandes {
+
+  /** Reads edges of one graph of a batch, n is the number of its vertices
+   * just as generic_read would count them. Returns false if the file cannot
+   * be opened, mapped or parsed, the graph is then skipped. */
+  template<typename EdgeType>
+    inline bool batch_graph(
+        Context& ctx,
+        const char* file_path,
+        const int64_t index,
+        std::vector<EdgeType>& E,
+        typename EdgeType::VertexId& n
+        ) {
+      n = 0;
+      try {
+        read_edges(file_path, ctx.input_format_, E, n);
+      } catch (const std::exception& error) {
+        fprintf(stderr, "Cannot read graph %lld (%s): %s, skipping.\n",
+            static_cast<long long>(index), file_path, error.what());
+        std::vector<EdgeType>().swap(E);
+        n = 0;
+        return false;
+      }
+      for (auto& e : E) {
+        n = (n <= e.v1_) ? e.v1_ + 1 : n;
+        n = (n <= e.v2_) ? e.v2_ + 1 : n;
+      }
+      return true;
+    }
+
+  /** Betweenness of graphs listed in a file, one path per line. Graphs are
+   * packed as disjoint components of combined graphs of up to capacity
+   * vertices (a bigger graph is computed on its own), every combined graph
+   * goes through the pipeline once, on one device context. Shortest paths
+   * never leave a component, so the device runs a source of every packed
+   * graph together, scores are split back and those of the i-th listed graph
+   * are written to prefix followed by i. Graphs which cannot be read get no
+   * output. */
+  template<typename Pipe, typename Return = std::vector<float>,
+    typename EdgeType = Edge>
+    inline void batch_run(
+        Context& ctx,
+        const char* list_path,
+        const char* out_prefix,
+        const char* mode,
+        const int64_t capacity
+        ) {
+      typedef typename EdgeType::VertexId VertexId;
+      std::vector<std::string> paths;
+      try {
+        for_each_line(list_path, [&](const char* first, const char* last) {
+            while (first != last && isspace(*first)) {
+              first++;
+            }
+            while (last != first && isspace(*(last - 1))) {
+              last--;
+            }
+            if (first != last && *first != '#') {
+              paths.push_back(std::string(first, last));
+            }
+            });
+      } catch (const std::exception& error) {
+        fprintf(stderr, "Cannot read %s: %s\n", list_path, error.what());
+        std::exit(EXIT_FAILURE);
+      }
+      const int64_t count = paths.size();
+      /* Combined graph of the pack being filled. */
+      std::vector<EdgeType> E;
+      std::vector<int64_t> members;
+      std::vector<VertexId> offsets;
+      VertexId n = 0;
+      int64_t packs = 0;
+      auto flush = [&]() {
+        MICROPROF_INFO("BATCH:\tpack\t%lld\tgraphs\t%zu\tvertices\t%d\n",
+            static_cast<long long>(packs), members.size(), n);
+        const Return bc = E.empty() ? Return(n, 0.0f)
+          : Pipe().template cont<Return>(ctx, n, E);
+        assert(bc.size() == static_cast<size_t>(n));
+        for (size_t k = 0; k < members.size(); k++) {
+          const VertexId lo = offsets[k],
+                hi = k + 1 < members.size() ? offsets[k + 1] : n;
+          const Return part(bc.begin() + lo, bc.begin() + hi);
+          generic_write(ctx, part, (out_prefix +
+                std::to_string(members[k])).c_str(), mode);
+        }
+        E.clear();
+        members.clear();
+        offsets.clear();
+        n = 0;
+        packs++;
+      };
+      /* Graphs are read in parallel a window at a time, then packed in
+       * order. */
+      const int64_t window = std::max(64, 4 * ctx.pool().size());
+      std::vector<std::vector<EdgeType>> graphs(std::min(window, count));
+      std::vector<VertexId> sizes(graphs.size());
+      std::vector<char> readable(graphs.size());
+      int64_t skipped = 0;
+      MICROPROF_START(batch);
+      for (int64_t lo = 0; lo < count; lo += window) {
+        const int64_t hi = std::min(lo + window, count);
+        MICROPROF_START(batch_reading);
+        ctx.pool().parallel_for(lo, hi, 1, [&](int64_t glo, int64_t ghi) {
+            for (int64_t g = glo; g < ghi; g++) {
+              readable[g - lo] = batch_graph(ctx, paths[g].c_str(), g,
+                  graphs[g - lo], sizes[g - lo]);
+            }
+            });
+        MICROPROF_END(batch_reading);
+        for (int64_t g = lo; g < hi; g++) {
+          if (!readable[g - lo]) {
+            skipped++;
+            continue;
+          }
+          std::vector<EdgeType>& G = graphs[g - lo];
+          const VertexId size = sizes[g - lo];
+          if (!members.empty() && n + static_cast<int64_t>(size) > capacity) {
+            flush();
+          }
+          members.push_back(g);
+          offsets.push_back(n);
+          for (EdgeType e : G) {
+            e.v1_ += n;
+            e.v2_ += n;
+            E.push_back(e);
+          }
+          n += size;
+          std::vector<EdgeType>().swap(G);
+        }
+      }
+      if (!members.empty()) {
+        flush();
+      }
+      MICROPROF_INFO("BATCH:\tgraphs\t%lld\tpacks\t%lld\tskipped\t%lld\n",
+          static_cast<long long>(count), static_cast<long long>(packs),
+          static_cast<long long>(skipped));
+      MICROPROF_END(batch);
+    }
+
+}  // namespace brandes
+
+#endif  // BRANDESBATCH_H_
@@ -3,6 +3,8 @@
 #define BRANDESBETWEENNESS_H_
 
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <vector>
 #include <chrono>
 #include <atomic>
@@ -19,6 +21,23 @@ namespace brandes {
         return value + factor - 1 - ((value - 1) % factor);
       }
 
+    /** Moves results accumulated on the device so far to the checkpoint. */
+    template<typename Return, typename VertexList>
+      static inline void checkpoint(
+          cl::CommandQueue& q,
+          cl::Buffer& bc_cl,
+          SourceDispatch<Return>& source_dispatch,
+          const int slot,
+          VertexList __pass__ finished,
+          const bool leaving
+          ) {
+        Return bc(source_dispatch.kN_);
+        q.enqueueReadBuffer(bc_cl, true, 0, bytes(bc), bc.data());
+        source_dispatch.deposit(slot, bc, finished, leaving);
+        /* Deposit has zeroed host copy. */
+        q.enqueueWriteBuffer(bc_cl, true, 0, bytes(bc), bc.data());
+      }
+
     template<typename Return, typename VertexList>
       inline Return cont(
           Context& ctx,
@@ -27,7 +46,7 @@ namespace brandes {
           const VertexList __pass__ ptr,
           const VertexList __pass__ adj,
           const Return __pass__ weight,
-          std::atomic_int& source_dispatch
+          SourceDispatch<Return>& source_dispatch
           ) const {
         typedef typename VertexList::value_type VertexId;
         typedef typename Return::value_type Result;
@@ -124,14 +143,34 @@ namespace brandes {
               NULL, add_to(kern_cts));
         }
 
+        /* Sources of different components run together, one per component,
+         * since shortest paths never leave a component each one keeps to its
+         * own slice of dist, sigma and delta. Components are consecutive
+         * ranges of vertices when the dispatch interleaves them. */
+        const std::vector<int>& bounds = source_dispatch.bounds_;
+        const VertexId ccs_count = bounds.empty() ? 1 : bounds.size() - 1;
+        VertexList comp(n);
+        for (VertexId cc = 0; cc < ccs_count; cc++) {
+          std::fill(comp.begin() + (bounds.empty() ? 0 : bounds[cc]),
+              comp.begin() + (bounds.empty() ? n : bounds[cc + 1]), cc);
+        }
+        std::vector<VertexId> roots(ccs_count, -1);
+        cl::Buffer comp_cl(acc.context_, CL_MEM_READ_ONLY, bytes(comp)),
+          roots_cl(acc.context_, CL_MEM_READ_ONLY, bytes(roots));
+        q.enqueueWriteBuffer(comp_cl, false, 0, bytes(comp), comp.data(),
+            NULL, add_to(mem_cts));
+        q.enqueueWriteBuffer(roots_cl, false, 0, bytes(roots), roots.data(),
+            NULL, add_to(mem_cts));
+
         /** We can move some arguments setting outside of the loop. */
-        cl::Kernel k_source(acc.program_, "vcsr_init_source");
+        cl::Kernel k_source(acc.program_, "vcsr_init_sources");
         k_source.setArg(0, n);
-        k_source.setArg(2, proceed_cl);
-        k_source.setArg(3, dist_cl);
-        k_source.setArg(4, sigma_cl);
+        k_source.setArg(1, proceed_cl);
+        k_source.setArg(2, comp_cl);
+        k_source.setArg(3, roots_cl);
+        k_source.setArg(4, dist_cl);
+        k_source.setArg(5, sigma_cl);
         cl::Kernel k_fwd(acc.program_, "vcsr_forward");
-        k_fwd.setArg(0, n1);
         k_fwd.setArg(2, ctx.kMDegLog2_);
         k_fwd.setArg(3, proceed_cl);
         k_fwd.setArg(4, vmap_cl);
@@ -142,7 +181,6 @@ namespace brandes {
         k_fwd.setArg(9, sigma_cl);
         k_fwd.setArg(10, red_cl);
         cl::Kernel k_fwd_red(acc.program_, "vcsr_forward_reduce");
-        k_fwd_red.setArg(0, n);
         k_fwd_red.setArg(2, proceed_cl);
         k_fwd_red.setArg(3, rmap_cl);
         k_fwd_red.setArg(4, weight_cl);
@@ -151,7 +189,6 @@ namespace brandes {
         k_fwd_red.setArg(7, delta_cl);
         k_fwd_red.setArg(8, red_cl);
         cl::Kernel k_back(acc.program_, "vcsr_backward");
-        k_back.setArg(0, n1);
         k_back.setArg(2, ctx.kMDegLog2_);
         k_back.setArg(3, vmap_cl);
         k_back.setArg(4, voff_cl);
@@ -161,22 +198,69 @@ namespace brandes {
         k_back.setArg(8, delta_cl);
         k_back.setArg(9, red_cl);
         cl::Kernel k_back_red(acc.program_, "vcsr_backward_reduce");
-        k_back_red.setArg(0, n);
         k_back_red.setArg(2, rmap_cl);
         k_back_red.setArg(3, dist_cl);
         k_back_red.setArg(4, delta_cl);
         k_back_red.setArg(5, red_cl);
-        cl::Kernel k_sum(acc.program_, "vcsr_sum");
-        k_sum.setArg(0, n);
-        k_sum.setArg(2, weight_cl);
-        k_sum.setArg(3, dist_cl);
-        k_sum.setArg(4, sigma_cl);
-        k_sum.setArg(5, delta_cl);
-        k_sum.setArg(6, bc_cl);
+        cl::Kernel k_sum(acc.program_, "vcsr_sum_sources");
+        k_sum.setArg(1, comp_cl);
+        k_sum.setArg(2, roots_cl);
+        k_sum.setArg(3, weight_cl);
+        k_sum.setArg(4, dist_cl);
+        k_sum.setArg(5, sigma_cl);
+        k_sum.setArg(6, delta_cl);
+        k_sum.setArg(7, bc_cl);
+
+        VertexList finished;
+        std::vector<VertexId> round;
+        /* Components whose roots are set on the device. */
+        VertexId set_lo = 0, set_hi = 0;
+        VertexId source, rounds = 0;
+        SourceBatchTrace trace(adj.size());
+        const int slot = source_dispatch.enroll("gpu");
+        source = source_dispatch.fetch();
+        while (source < n) {
+          /* Takes sources until one falls into a component which already
+           * has its own, that one opens the next round. */
+          VertexId cc_lo = ccs_count, cc_hi = 0;
+          round.clear();
+          for (; source < n; source = source_dispatch.fetch()) {
+            const VertexId cc = comp[source];
+            if (roots[cc] != -1) {
+              break;
+            }
+            roots[cc] = source;
+            round.push_back(source);
+            cc_lo = std::min(cc_lo, cc);
+            cc_hi = std::max(cc_hi, cc + 1);
+          }
+          /* Roots of the previous round are cleared on the device too. */
+          const VertexId up_lo = set_hi > set_lo ? std::min(cc_lo, set_lo)
+            : cc_lo, up_hi = std::max(cc_hi, set_hi);
+          q.enqueueWriteBuffer(roots_cl, false, sizeof(VertexId) * up_lo,
+              sizeof(VertexId) * (up_hi - up_lo), roots.data() + up_lo,
+              NULL, add_to(mem_cts));
+          set_lo = cc_lo;
+          set_hi = cc_hi;
+          /* Levels are expanded over the vertices of the round only. */
+          const VertexId lo = bounds.empty() ? 0 : bounds[cc_lo],
+                hi = bounds.empty() ? n : bounds[cc_hi],
+                vlo = std::lower_bound(vmap.begin(), vmap.end(), lo) -
+                  vmap.begin(),
+                vhi = std::lower_bound(vmap.begin(), vmap.end(), hi) -
+                  vmap.begin();
+          const VertexId lo_off = lo - lo % ctx.kWGroup_,
+                vlo_off = vlo - vlo % ctx.kWGroup_;
+          cl::NDRange span_offset(lo_off),
+            span_global(round_up(hi - lo_off, ctx.kWGroup_)),
+            vspan_offset(vlo_off),
+            vspan_global(round_up(vhi - vlo_off, ctx.kWGroup_));
+          k_fwd.setArg(0, vhi);
+          k_fwd_red.setArg(0, hi);
+          k_back.setArg(0, vhi);
+          k_back_red.setArg(0, hi);
+          k_sum.setArg(0, hi);
 
-        VertexId source;
-        while ((source = source_dispatch++) < n) {
-          k_source.setArg(1, source);
           q.enqueueNDRangeKernel(k_source, cl::NullRange, n_global, local,
               NULL, add_to(kern_cts));
 
@@ -184,19 +268,19 @@ namespace brandes {
           VertexId curr_dist = 0;
           do {
             k_fwd.setArg(1, curr_dist);
-            q.enqueueNDRangeKernel(k_fwd, cl::NullRange, n1_global, local,
+            q.enqueueNDRangeKernel(k_fwd, vspan_offset, vspan_global, local,
                 NULL, add_to(kern_cts));
             /* Note that we must first obtain proceed flag and then run
              * parallel reduction kernel as it sets proceed to false. */
             cl::Event evt;
             q.enqueueReadBuffer(proceed_cl, false, 0, sizeof(bool), &proceed,
                 NULL, &evt);
-            /* Performing aggregation for source (curr_dist == 0) is not
+            /* Performing aggregation for sources (curr_dist == 0) is not
              * correct since we explicitly set sigma[source] = 1. */
             if (curr_dist > 0) {
               k_fwd_red.setArg(1, curr_dist);
-              q.enqueueNDRangeKernel(k_fwd_red, cl::NullRange, n_global, local,
-                  NULL, add_to(kern_cts));
+              q.enqueueNDRangeKernel(k_fwd_red, span_offset, span_global,
+                  local, NULL, add_to(kern_cts));
             }
             curr_dist++;
             /* The fact that we use specific event instead of clFinish() call
@@ -211,15 +295,14 @@ namespace brandes {
 
           while (--curr_dist > 0) {
             k_back.setArg(1, curr_dist);
-            q.enqueueNDRangeKernel(k_back, cl::NullRange, n1_global, local,
+            q.enqueueNDRangeKernel(k_back, vspan_offset, vspan_global, local,
                 NULL, add_to(kern_cts));
             k_back_red.setArg(1, curr_dist);
-            q.enqueueNDRangeKernel(k_back_red, cl::NullRange, n_global, local,
-                NULL, add_to(kern_cts));
+            q.enqueueNDRangeKernel(k_back_red, span_offset, span_global,
+                local, NULL, add_to(kern_cts));
           }
 
-          k_sum.setArg(1, source);
-          q.enqueueNDRangeKernel(k_sum, cl::NullRange, n_global, local,
+          q.enqueueNDRangeKernel(k_sum, span_offset, span_global, local,
               NULL, add_to(kern_cts));
 
 #ifdef MYCL_QUEUE_PROFILING
@@ -232,9 +315,28 @@ namespace brandes {
             kern_cts.erase(consume_begin, consume_end);
           }
 #endif
-          if (source % (n / 24) == 0) {
-            MICROPROF_INFO("PROGRESS:\t%d / %d\n", source, n);
+          /* The write of roots has completed before the proceed flag was
+           * read, so that host copy can be cleared. */
+          for (const VertexId root : round) {
+            roots[comp[root]] = -1;
+            if (source_dispatch.kPath_) {
+              finished.push_back(root);
+            }
+            trace.step();
+            source_dispatch.progress(slot);
+            if (root % (n / 24 + 1) == 0) {
+              MICROPROF_INFO("PROGRESS:\t%d / %d\n", root, n);
+            }
           }
+          if (source_dispatch.kPath_ && source_dispatch.owes(slot)) {
+            checkpoint(q, bc_cl, source_dispatch, slot, finished, false);
+          }
+          rounds++;
+        }
+        MICROPROF_INFO("GPU:\tsource rounds\t%d\n", rounds);
+        SUPPRESS_UNUSED(rounds);
+        if (source_dispatch.kPath_) {
+          checkpoint(q, bc_cl, source_dispatch, slot, finished, true);
         }
 #ifndef MYCL_QUEUE_PROFILING
         q.finish();
@@ -262,6 +364,269 @@ namespace brandes {
 #endif
         return bc;
       }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          const VertexList __pass__ vmap,
+          const VertexList __pass__ voff,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const LengthList __pass__ len,
+          const Return __pass__ weight,
+          SourceDispatch<Return>& source_dispatch
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        typedef typename LengthList::value_type Length;
+        typedef typename Return::value_type Result;
+        static_assert(sizeof(VertexId) == sizeof(cl_int),
+            "VertexId type not compatible");
+        static_assert(sizeof(Length) == sizeof(cl_float),
+            "Length type not compatible");
+        static_assert(sizeof(Result) == sizeof(cl_float),
+            "Result type not compatible");
+
+        cl::NDRange local(ctx.kWGroup_);
+        const VertexId n = ptr.size() - 1;
+        cl::NDRange n_global(round_up(n + 1, ctx.kWGroup_));
+        const VertexId n1 = vmap.size() - 1;
+        cl::NDRange n1_global(round_up(n1 + 1, ctx.kWGroup_));
+        const Length delta = sssp_delta(ctx, len);
+        const Length kHalf = sssp_half(len);
+        const Length kUnreached = sssp_unreached<Length>();
+        cl_int kUnreachedBits;
+        std::memcpy(&kUnreachedBits, &kUnreached, sizeof(kUnreachedBits));
+
+        assert(vmap.back() == n);
+        assert(voff.back() == 0);
+        assert(static_cast<size_t>(ptr.back()) == adj.size());
+        assert(len.size() == adj.size());
+
+        MICROPROF_INFO("CONFIGURATION:\twork group\t%d\n", ctx.kWGroup_);
+        MICROPROF_START(device_wait);
+        Accelerator acc = ctx.dev_future_.get();
+        cl::CommandQueue& q = acc.queue_;
+        MICROPROF_END(device_wait);
+
+        MICROBENCH_TIMEPOINT(moving_data);
+        MICROPROF_START(graph_to_gpu);
+        cl::Buffer proceed_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(bool));
+        cl::Buffer next_min_cl(acc.context_, CL_MEM_READ_WRITE,
+            sizeof(cl_int));
+        cl::Buffer vmap_cl(acc.context_, CL_MEM_READ_ONLY, bytes(vmap));
+        q.enqueueWriteBuffer(vmap_cl, false, 0, bytes(vmap), vmap.data());
+        cl::Buffer voff_cl(acc.context_, CL_MEM_READ_ONLY, bytes(voff));
+        q.enqueueWriteBuffer(voff_cl, false, 0, bytes(voff), voff.data());
+        cl::Buffer rmap_cl(acc.context_, CL_MEM_READ_ONLY, bytes(vmap));
+        cl::Buffer ptr_cl(acc.context_, CL_MEM_READ_ONLY, bytes(ptr));
+        q.enqueueWriteBuffer(ptr_cl, false, 0, bytes(ptr), ptr.data());
+        cl::Buffer adj_cl(acc.context_, CL_MEM_READ_ONLY, bytes(adj));
+        q.enqueueWriteBuffer(adj_cl, false, 0, bytes(adj), adj.data());
+        cl::Buffer len_cl(acc.context_, CL_MEM_READ_ONLY, bytes(len));
+        q.enqueueWriteBuffer(len_cl, false, 0, bytes(len), len.data());
+        cl::Buffer weight_cl(acc.context_, CL_MEM_READ_ONLY, bytes(weight));
+        q.enqueueWriteBuffer(weight_cl, false, 0, bytes(weight), weight.data());
+        cl::Buffer
+          dist_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(Length) * n),
+          sigma_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(SigmaInt) * n),
+          delta_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(Result) * n),
+          dirty0_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(cl_char) * n),
+          dirty1_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(cl_char) * n),
+          red_cl(acc.context_, CL_MEM_READ_WRITE, std::max(sizeof(SigmaInt),
+                sizeof(Result)) * n1),
+          bc_cl(acc.context_, CL_MEM_READ_WRITE, sizeof(Result) * n);
+        MICROPROF_END(graph_to_gpu);
+
+        MICROBENCH_TIMEPOINT(starting_kernels);
+        {
+          cl::Kernel k_init_n(acc.program_, "vcsr_init_n");
+          k_init_n.setArg(0, n);
+          k_init_n.setArg(1, bc_cl);
+          q.enqueueNDRangeKernel(k_init_n, cl::NullRange, n_global, local);
+          /* The second dirty set must start empty, the first one is set up
+           * together with every source. */
+          std::vector<cl_char> zeros(n);
+          q.enqueueWriteBuffer(dirty1_cl, true, 0, bytes(zeros), zeros.data());
+        }
+        {
+          cl::Kernel k_init_n1(acc.program_, "vcsr_init_n1");
+          k_init_n1.setArg(0, n1 + 1);
+          k_init_n1.setArg(1, n1);
+          k_init_n1.setArg(2, vmap_cl);
+          k_init_n1.setArg(3, voff_cl);
+          k_init_n1.setArg(4, rmap_cl);
+          q.enqueueNDRangeKernel(k_init_n1, cl::NullRange, n1_global, local);
+        }
+
+        cl::Kernel k_source(acc.program_, "wcsr_init_source");
+        k_source.setArg(0, n);
+        k_source.setArg(2, proceed_cl);
+        k_source.setArg(3, dist_cl);
+        k_source.setArg(4, sigma_cl);
+        k_source.setArg(5, dirty0_cl);
+        cl::Kernel k_relax(acc.program_, "wcsr_relax");
+        k_relax.setArg(0, n1);
+        k_relax.setArg(2, ctx.kMDegLog2_);
+        k_relax.setArg(3, proceed_cl);
+        k_relax.setArg(4, vmap_cl);
+        k_relax.setArg(5, voff_cl);
+        k_relax.setArg(6, ptr_cl);
+        k_relax.setArg(7, adj_cl);
+        k_relax.setArg(8, len_cl);
+        k_relax.setArg(9, dist_cl);
+        cl::Kernel k_carry(acc.program_, "wcsr_carry");
+        k_carry.setArg(0, n);
+        k_carry.setArg(2, proceed_cl);
+        k_carry.setArg(3, dist_cl);
+        cl::Kernel k_next(acc.program_, "wcsr_next_bucket");
+        k_next.setArg(0, n);
+        k_next.setArg(1, dist_cl);
+        k_next.setArg(3, next_min_cl);
+        cl::Kernel k_sigma(acc.program_, "wcsr_sigma");
+        k_sigma.setArg(0, n1);
+        k_sigma.setArg(1, ctx.kMDegLog2_);
+        k_sigma.setArg(2, kHalf);
+        k_sigma.setArg(3, proceed_cl);
+        k_sigma.setArg(4, vmap_cl);
+        k_sigma.setArg(5, voff_cl);
+        k_sigma.setArg(6, ptr_cl);
+        k_sigma.setArg(7, adj_cl);
+        k_sigma.setArg(8, len_cl);
+        k_sigma.setArg(9, dist_cl);
+        k_sigma.setArg(10, sigma_cl);
+        k_sigma.setArg(11, red_cl);
+        cl::Kernel k_sigma_red(acc.program_, "wcsr_sigma_reduce");
+        k_sigma_red.setArg(0, n);
+        k_sigma_red.setArg(2, proceed_cl);
+        k_sigma_red.setArg(3, rmap_cl);
+        k_sigma_red.setArg(4, weight_cl);
+        k_sigma_red.setArg(5, dist_cl);
+        k_sigma_red.setArg(6, sigma_cl);
+        k_sigma_red.setArg(7, delta_cl);
+        k_sigma_red.setArg(8, red_cl);
+        cl::Kernel k_delta(acc.program_, "wcsr_delta");
+        k_delta.setArg(0, n1);
+        k_delta.setArg(1, ctx.kMDegLog2_);
+        k_delta.setArg(2, kHalf);
+        k_delta.setArg(3, proceed_cl);
+        k_delta.setArg(4, vmap_cl);
+        k_delta.setArg(5, voff_cl);
+        k_delta.setArg(6, ptr_cl);
+        k_delta.setArg(7, adj_cl);
+        k_delta.setArg(8, len_cl);
+        k_delta.setArg(9, dist_cl);
+        k_delta.setArg(10, delta_cl);
+        k_delta.setArg(11, red_cl);
+        cl::Kernel k_delta_red(acc.program_, "wcsr_delta_reduce");
+        k_delta_red.setArg(0, n);
+        k_delta_red.setArg(1, proceed_cl);
+        k_delta_red.setArg(2, rmap_cl);
+        k_delta_red.setArg(3, weight_cl);
+        k_delta_red.setArg(4, dist_cl);
+        k_delta_red.setArg(5, sigma_cl);
+        k_delta_red.setArg(6, delta_cl);
+        k_delta_red.setArg(7, red_cl);
+        cl::Kernel k_sum(acc.program_, "wcsr_sum");
+        k_sum.setArg(0, n);
+        k_sum.setArg(2, weight_cl);
+        k_sum.setArg(3, dist_cl);
+        k_sum.setArg(4, sigma_cl);
+        k_sum.setArg(5, delta_cl);
+        k_sum.setArg(6, bc_cl);
+
+        /* Dirty sets are swapped after every relaxation round, we keep track
+         * of which one holds vertices to be relaxed. */
+        cl::Buffer* dirty_in = &dirty0_cl;
+        cl::Buffer* dirty_out = &dirty1_cl;
+        VertexList finished;
+        VertexId source;
+        SourceBatchTrace trace(adj.size());
+        const int slot = source_dispatch.enroll("gpu");
+        while ((source = source_dispatch.fetch()) < n) {
+          k_source.setArg(1, source);
+          k_source.setArg(5, *dirty_in);
+          q.enqueueNDRangeKernel(k_source, cl::NullRange, n_global, local);
+
+          Length bound = delta;
+          for (;;) {
+            bool proceed;
+            do {
+              k_relax.setArg(1, bound);
+              k_relax.setArg(10, *dirty_in);
+              k_relax.setArg(11, *dirty_out);
+              q.enqueueNDRangeKernel(k_relax, cl::NullRange, n1_global, local);
+              cl::Event evt;
+              q.enqueueReadBuffer(proceed_cl, false, 0, sizeof(bool), &proceed,
+                  NULL, &evt);
+              k_carry.setArg(1, bound);
+              k_carry.setArg(4, *dirty_in);
+              k_carry.setArg(5, *dirty_out);
+              q.enqueueNDRangeKernel(k_carry, cl::NullRange, n_global, local);
+              std::swap(dirty_in, dirty_out);
+              evt.wait();
+            } while (proceed);
+            cl_int next_min = kUnreachedBits;
+            q.enqueueWriteBuffer(next_min_cl, false, 0, sizeof(cl_int),
+                &next_min);
+            k_next.setArg(2, *dirty_in);
+            q.enqueueNDRangeKernel(k_next, cl::NullRange, n_global, local);
+            q.enqueueReadBuffer(next_min_cl, true, 0, sizeof(cl_int),
+                &next_min);
+            if (next_min == kUnreachedBits) {
+              break;
+            }
+            Length next_dist;
+            std::memcpy(&next_dist, &next_min, sizeof(next_dist));
+            bound = (std::floor(next_dist / delta) + 1) * delta;
+          }
+
+          bool proceed;
+          do {
+            q.enqueueNDRangeKernel(k_sigma, cl::NullRange, n1_global, local);
+            k_sigma_red.setArg(1, source);
+            q.enqueueNDRangeKernel(k_sigma_red, cl::NullRange, n_global,
+                local);
+            q.enqueueReadBuffer(proceed_cl, true, 0, sizeof(bool), &proceed);
+          } while (proceed);
+          do {
+            q.enqueueNDRangeKernel(k_delta, cl::NullRange, n1_global, local);
+            q.enqueueNDRangeKernel(k_delta_red, cl::NullRange, n_global,
+                local);
+            q.enqueueReadBuffer(proceed_cl, true, 0, sizeof(bool), &proceed);
+          } while (proceed);
+
+          k_sum.setArg(1, source);
+          q.enqueueNDRangeKernel(k_sum, cl::NullRange, n_global, local);
+
+          if (source_dispatch.kPath_) {
+            finished.push_back(source);
+            if (source_dispatch.owes(slot)) {
+              checkpoint(q, bc_cl, source_dispatch, slot, finished, false);
+            }
+          }
+          trace.step();
+          source_dispatch.progress(slot);
+          if (source % (n / 24 + 1) == 0) {
+            MICROPROF_INFO("PROGRESS:\t%d / %d\n", source, n);
+          }
+        }
+        if (source_dispatch.kPath_) {
+          checkpoint(q, bc_cl, source_dispatch, slot, finished, true);
+        }
+        q.finish();
+        MICROBENCH_TIMEPOINT(kernels_completed);
+
+        Return bc(n);
+        q.enqueueReadBuffer(bc_cl, true, 0, bytes(bc), bc.data());
+        q.finish();
+
+        MICROBENCH_TIMEPOINT(fetched_results);
+        MICROBENCH_REPORT(starting_kernels, kernels_completed, stderr, "%ld\n",
+            std::chrono::milliseconds);
+        MICROBENCH_REPORT(moving_data, fetched_results, stderr, "%ld\n",
+            std::chrono::milliseconds);
+        return bc;
+      }
   };
 
 }  // namespace brandes
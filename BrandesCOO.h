@@ -5,9 +5,26 @@
 #include <boost/fusion/adapted.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+
+#include <sys/stat.h>
 
 #include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
 #include <vector>
+#include <string>
+#include <algorithm>
 
 #include "./BrandesCommons.h"
 
@@ -19,35 +36,360 @@ namespace brandes {
     VertexId v2_;
   };
 
-  template<typename Cont, typename Return = std::vector<float>>
-    inline Return generic_read(Context& ctx, const char* file_path) {
-      const size_t kEdgesInit = 1<<20;
-      using boost::iostreams::mapped_file;
+  struct WeightedEdge {
+    typedef int VertexId;
+    typedef float Length;
+    VertexId v1_;
+    VertexId v2_;
+    Length len_;
+  };
+
+  /** Reads the edge at the beginning of a line, columns which follow are
+   * ignored. */
+  template<typename Iterator>
+    inline bool parse_edge(Iterator first, Iterator last, Edge& e) {
+      using boost::spirit::qi::phrase_parse;
+      using boost::spirit::qi::int_;
+      using boost::spirit::ascii::blank;
+      return phrase_parse(first, last, int_ >> int_, blank, e);
+    }
+
+  template<typename Iterator>
+    inline bool parse_edge(Iterator first, Iterator last, WeightedEdge& e) {
       using boost::spirit::qi::phrase_parse;
       using boost::spirit::qi::int_;
-      using boost::spirit::qi::eol;
+      using boost::spirit::qi::float_;
       using boost::spirit::ascii::blank;
+      return phrase_parse(first, last, int_ >> int_ >> float_, blank, e);
+    }
+
+  template<typename Iterator>
+    inline bool parse_numbers(Iterator first, Iterator last,
+        std::vector<double>& values) {
+      using boost::spirit::qi::phrase_parse;
+      using boost::spirit::qi::double_;
+      using boost::spirit::ascii::blank;
+      values.clear();
+      return phrase_parse(first, last, *double_, blank, values) &&
+        first == last;
+    }
+
+  inline void set_length(Edge&, double) {}
+
+  inline void set_length(WeightedEdge& e, double len) {
+    e.len_ = static_cast<WeightedEdge::Length>(len);
+  }
+
+  inline bool valid_length(const Edge&) {
+    return true;
+  }
+
+  /* Dijkstra-like engines cannot handle lengths which are not positive. */
+  inline bool valid_length(const WeightedEdge& e) {
+    return e.len_ > 0 && std::isfinite(e.len_);
+  }
+
+  inline bool ends_with(const std::string& str, const char* suffix) {
+    const size_t len = strlen(suffix);
+    return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+  }
+
+  /** Malformed input file, what() names the file and the line. */
+  struct InputError : public std::runtime_error {
+    explicit InputError(const std::string& what) : std::runtime_error(what) {}
+  };
+
+  /** Line 0 stands for the file as a whole. */
+  inline void input_failed(const char* file_path, int64_t lineno,
+      const char* what) {
+    throw InputError(std::string(file_path) + (lineno > 0 ? ", line " +
+          std::to_string(lineno) : std::string()) + ": " + what);
+  }
+
+  /** Calls line(first, last) for every line of a file without its line
+   * terminator. Plain files are mapped, gzip or bzip2 compressed ones (by
+   * extension) and standard input ("-") are decompressed and read through a
+   * buffer of a few lines, so that nothing is stored uncompressed. An empty
+   * file has no lines, files which cannot be opened raise InputError. */
+  template<typename Line>
+    inline void for_each_line(const char* file_path, Line line) {
+      using boost::iostreams::mapped_file;
+      auto split = [&line](const char* first, const char* last) -> const char* {
+        for (const char* eol; (eol = static_cast<const char*>(
+                memchr(first, '\n', last - first))); first = eol + 1) {
+          line(first, eol > first && eol[-1] == '\r' ? eol - 1 : eol);
+        }
+        return first;
+      };
+      const std::string path(file_path);
+      const bool gzip = ends_with(path, ".gz"), bzip2 = ends_with(path, ".bz2");
+      if (path != "-" && !gzip && !bzip2) {
+        struct stat st;
+        if (stat(file_path, &st) != 0) {
+          input_failed(file_path, 0, strerror(errno));
+        } else if (st.st_size == 0) {
+          return;
+        }
+        mapped_file mf;
+        try {
+          mf.open(file_path, mapped_file::readonly);
+        } catch (const std::ios_base::failure& error) {
+          input_failed(file_path, 0, error.what());
+        }
+        const char* first = mf.const_data();
+        const char* last = first + mf.size();
+        first = split(first, last);
+        if (first != last) {
+          line(first, last);
+        }
+        return;
+      }
+      namespace io = boost::iostreams;
+      io::filtering_istream in;
+      if (gzip) {
+        in.push(io::gzip_decompressor());
+      } else if (bzip2) {
+        in.push(io::bzip2_decompressor());
+      }
+      if (path == "-") {
+        in.push(std::cin);
+      } else {
+        in.push(io::file_source(file_path, std::ios::in | std::ios::binary));
+      }
+      std::vector<char> buffer(1 << 20);
+      size_t filled = 0;
+      for (;;) {
+        in.read(buffer.data() + filled, buffer.size() - filled);
+        const size_t got = in.gcount();
+        filled += got;
+        const char* first = buffer.data();
+        const char* last = first + filled;
+        first = split(first, last);
+        if (got == 0) {
+          if (in.bad()) {
+            input_failed(file_path, 0, "decompression failed");
+          } else if (first != last) {
+            line(first, last);
+          }
+          return;
+        }
+        filled = last - first;
+        memmove(buffer.data(), first, filled);
+        if (filled == buffer.size()) {
+          buffer.resize(2 * buffer.size());
+        }
+      }
+    }
+
+  /** Lists edges of a graph in a format given by name or picked by the
+   * extension which precedes .gz or .bz2, n is raised to the number of
+   * vertices declared by the file.
+   * - Edge lists (default) hold u v [length] lines of 0-based vertices,
+   *   lines starting with # or % are comments, as in SNAP files.
+   * - Matrix Market (mtx) coordinate files list 1-based entries of a
+   *   pattern, integer or real matrix, values are edge lengths.
+   * - METIS (graph, metis) adjacency files list 1-based neighbours (and edge
+   *   weights, which become lengths) of every vertex in order, each edge is
+   *   taken once.
+   * Malformed files raise InputError. */
+  template<typename EdgeType>
+    inline void read_edges(
+        const char* file_path,
+        const char* format,
+        std::vector<EdgeType>& E,
+        typename EdgeType::VertexId& n
+        ) {
+      typedef typename EdgeType::VertexId VertexId;
+      std::string name = format ? format : "";
+      if (name.empty()) {
+        std::string path(file_path);
+        for (const char* zip : { ".gz", ".bz2" }) {
+          if (ends_with(path, zip)) {
+            path.resize(path.size() - strlen(zip));
+          }
+        }
+        name = ends_with(path, ".mtx") ? "mtx"
+          : ends_with(path, ".graph") || ends_with(path, ".metis") ? "metis"
+          : "edges";
+      }
+      int64_t lineno = 0;
+      if (name == "edges") {
+        for_each_line(file_path, [&](const char* first, const char* last) {
+            lineno++;
+            while (first != last && (*first == ' ' || *first == '\t')) {
+              first++;
+            }
+            if (first == last || *first == '#' || *first == '%') {
+              return;
+            }
+            EdgeType e;
+            set_length(e, 1.0);
+            if (!parse_edge(first, last, e) || e.v1_ < 0 || e.v2_ < 0) {
+              input_failed(file_path, lineno, "expected an edge");
+            } else if (!valid_length(e)) {
+              input_failed(file_path, lineno, "expected a positive length");
+            }
+            E.push_back(e);
+            });
+      } else if (name == "mtx") {
+        bool sized = false, pattern = false;
+        VertexId rows = 0, cols = 0;
+        std::vector<double> values;
+        for_each_line(file_path, [&](const char* first, const char* last) {
+            lineno++;
+            if (lineno == 1) {
+              std::string header(first, last);
+              std::transform(header.begin(), header.end(), header.begin(),
+                  ::tolower);
+              if (header.compare(0, 14, "%%matrixmarket") != 0 ||
+                  header.find("coordinate") == std::string::npos ||
+                  header.find("complex") != std::string::npos) {
+                input_failed(file_path, lineno,
+                    "expected a real, integer or pattern coordinate matrix");
+              }
+              pattern = header.find("pattern") != std::string::npos;
+              return;
+            } else if (first == last || *first == '%') {
+              return;
+            } else if (!parse_numbers(first, last, values) ||
+                values.size() < (sized ? (pattern ? 2u : 3u) : 3u)) {
+              input_failed(file_path, lineno, "expected matrix entry");
+            } else if (!sized) {
+              rows = values[0];
+              cols = values[1];
+              n = std::max(n, std::max(rows, cols));
+              E.reserve(static_cast<size_t>(values[2]));
+              sized = true;
+              return;
+            }
+            EdgeType e;
+            e.v1_ = static_cast<VertexId>(values[0]) - 1;
+            e.v2_ = static_cast<VertexId>(values[1]) - 1;
+            set_length(e, pattern ? 1.0 : values[2]);
+            if (e.v1_ < 0 || e.v2_ < 0) {
+              input_failed(file_path, lineno, "indices start from 1");
+            } else if (e.v1_ >= rows || e.v2_ >= cols) {
+              input_failed(file_path, lineno, "index beyond matrix size");
+            } else if (!valid_length(e)) {
+              input_failed(file_path, lineno, "expected a positive length");
+            }
+            E.push_back(e);
+            });
+      } else if (name == "metis") {
+        bool sized = false;
+        int sizes = 0, weights = 0, lengths = 0;
+        VertexId u = 0, count = 0;
+        std::vector<double> values;
+        for_each_line(file_path, [&](const char* first, const char* last) {
+            lineno++;
+            if (first != last && *first == '%') {
+              return;
+            } else if (!parse_numbers(first, last, values)) {
+              input_failed(file_path, lineno, "expected numbers");
+            } else if (!sized) {
+              if (values.size() < 2) {
+                input_failed(file_path, lineno, "expected vertex count");
+              }
+              count = values[0];
+              n = std::max(n, count);
+              E.reserve(static_cast<size_t>(values[1]));
+              const int fmt = values.size() > 2 ? values[2] : 0;
+              sizes = fmt / 100 % 10;
+              weights = fmt / 10 % 10 ? (values.size() > 3 ? values[3] : 1) : 0;
+              lengths = fmt % 10;
+              sized = true;
+              return;
+            }
+            /* Blank lines stand for isolated vertices, trailing ones are
+             * allowed past the last vertex. */
+            if (u >= count) {
+              if (!values.empty()) {
+                input_failed(file_path, lineno, "more vertices than declared");
+              }
+              return;
+            }
+            const size_t skip = sizes + weights, step = 1 + lengths;
+            if (values.size() < skip || (values.size() - skip) % step != 0) {
+              input_failed(file_path, lineno, "malformed adjacency list");
+            }
+            for (size_t i = skip; i < values.size(); i += step) {
+              const VertexId v = static_cast<VertexId>(values[i]) - 1;
+              if (v < 0) {
+                input_failed(file_path, lineno, "indices start from 1");
+              } else if (v >= count) {
+                input_failed(file_path, lineno, "vertex beyond declared count");
+              }
+              if (u < v) {
+                EdgeType e;
+                e.v1_ = u;
+                e.v2_ = v;
+                set_length(e, lengths ? values[i + 1] : 1.0);
+                if (!valid_length(e)) {
+                  input_failed(file_path, lineno, "expected a positive length");
+                }
+                E.push_back(e);
+              }
+            }
+            u++;
+            });
+      } else {
+        input_failed(file_path, 0, "unknown format");
+      }
+    }
+
+  /** Result of a graph without edges, which has no shortest paths through
+   * any of its n vertices, so that stages need not handle such graphs. */
+  template<typename Return> struct EmptyGraph {
+    template<typename VertexId>
+      static inline Return result(const VertexId n) {
+        return Return(n);
+      }
+  };
+
+  /** Edge lists are handed back empty. */
+  template<typename EdgeList> struct EmptyEdges {
+    template<typename VertexId>
+      static inline EdgeList result(const VertexId) {
+        return EdgeList();
+      }
+  };
+
+  template<> struct EmptyGraph<std::vector<Edge>>
+    : public EmptyEdges<std::vector<Edge>> {};
+
+  template<> struct EmptyGraph<std::vector<WeightedEdge>>
+    : public EmptyEdges<std::vector<WeightedEdge>> {};
+
+  template<typename Cont, typename Return = std::vector<float>,
+    typename EdgeType = Edge>
+    inline Return generic_read(Context& ctx, const char* file_path) {
+      const size_t kEdgesInit = 1<<20;
       MICROPROF_START(reading_graph);
-      mapped_file mf(file_path, mapped_file::readonly);
-      std::vector<Edge> E;
+      MICROMEM_BEGIN(reading_graph);
+      std::vector<EdgeType> E;
       E.reserve(kEdgesInit);
-      {
-        auto dat0 = mf.const_data(), dat1 = dat0 + mf.size();
-        bool r = phrase_parse(dat0, dat1, (int_ >> int_) % eol > eol, blank, E);
-        assert(r); SUPPRESS_UNUSED(r);
-        assert(dat0 == dat1);
+      typename EdgeType::VertexId n = 0;
+      try {
+        read_edges(file_path, ctx.input_format_, E, n);
+      } catch (const InputError& error) {
+        fprintf(stderr, "Cannot read %s\n", error.what());
+        std::exit(EXIT_FAILURE);
       }
-      Edge::VertexId n = 0;
       for (auto& e : E) {
         n = (n <= e.v1_) ? e.v1_ + 1 : n;
         n = (n <= e.v2_) ? e.v2_ + 1 : n;
       }
-      assert(!E.empty());
+      if (E.empty()) {
+        MICROMEM_END(reading_graph);
+        MICROPROF_END(reading_graph);
+        return EmptyGraph<Return>::result(n);
+      }
 #ifndef NDEBUG
-      for (const Edge& e : E) {
+      for (const EdgeType& e : E) {
         assert(n > e.v1_ && n > e.v2_);
       }
 #endif  // NDEBUG
+      MICROMEM_END(reading_graph);
       MICROPROF_END(reading_graph);
       return CONT_BIND(ctx, n, E);
     }
@@ -58,4 +400,9 @@ BOOST_FUSION_ADAPT_STRUCT(brandes::Edge,
     (brandes::Edge::VertexId, v1_)
     (brandes::Edge::VertexId, v2_))
 
+BOOST_FUSION_ADAPT_STRUCT(brandes::WeightedEdge,
+    (brandes::WeightedEdge::VertexId, v1_)
+    (brandes::WeightedEdge::VertexId, v2_)
+    (brandes::WeightedEdge::Length, len_))
+
 #endif  // BRANDESCOO_H_
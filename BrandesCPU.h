@@ -3,52 +3,402 @@
 #define BRANDESCPU_H_
 
 #include <cassert>
+#include <cstdint>
 #include <vector>
+#include <limits>
 #include <atomic>
 #include <future>
+#include <memory>
+#include <algorithm>
 
-#include "./BrandesDEG1.h"
+#include "./BrandesSSSP.h"
+#include "./BrandesSIMD.h"
+#include "./BrandesDistributed.h"
+
+/* Width of BFS levels of the compact per-source state, 0 keeps separate
+ * arrays of full width. */
+#ifndef COMPACT_STATE
+#define COMPACT_STATE 0
+#endif
 
 namespace brandes {
 
-  typedef int SigmaInt;
+  /** Per-source scratch space of a CPU worker. */
+  template<typename Return, typename VertexList> struct CPUSourceState {
+    Return delta_;
+    VertexList queue_;
+    VertexList dist_;
+    HugeVector<SigmaInt> sigma_;
+
+    explicit CPUSourceState(size_t n) :
+      delta_(n), queue_(n), dist_(n), sigma_(n) {}
+  };
+
+  /** Adds dependencies of all vertices on given source multiplied by scale
+   * to bc, the scale is normally the weight of the source. Vertices reachable
+   * from the source lie in [lo, hi), state of others is left as it was. */
+  template<typename Return, typename VertexList, typename Accumulator>
+    static inline void bc_cpu_source(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const Return __pass__ weight,
+        const typename VertexList::value_type source,
+        const typename VertexList::value_type lo,
+        const typename VertexList::value_type hi,
+        const typename Accumulator::value_type scale,
+        CPUSourceState<Return, VertexList> __pass__ state,
+        Accumulator __pass__ bc
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      Return& delta = state.delta_;
+      VertexList& queue = state.queue_;
+      VertexList& dist = state.dist_;
+      HugeVector<SigmaInt>& sigma = state.sigma_;
+      const SimdLevel simd = simd_level();
+      auto qfront = queue.begin(), qback = qfront;
+      /* Init source. */
+      assert(lo <= source && source < hi &&
+          hi < static_cast<VertexId>(ptr.size()));
+      std::fill(dist.begin() + lo, dist.begin() + hi, -1);
+      dist[source] = 0;
+      std::fill(sigma.begin() + lo, sigma.begin() + hi, 0);
+      sigma[source] = 1;
+      *qback++ = source;
+      /* Forward, unvisited neighbours and those one level further. */
+      while (qfront != qback) {
+        VertexId v = *qfront++;
+        assert(lo <= v && v < hi);
+        const VertexId dist_w = dist[v] + 1;
+        simd_select(simd, adj.data() + ptr[v], adj.data() + ptr[v + 1],
+            dist.data(), -1, dist_w, [&](const VertexId w) {
+            assert(lo <= w && w < hi);
+            if (dist[w] < 0) {
+              *qback++ = w;
+              dist[w] = dist_w;
+            }
+            if (dist[w] == dist_w) {
+              sigma[w] += sigma[v];
+              assert(sigma[w] >= 0);
+            }
+            });
+      }
+      /* Intermediate. */
+      simd_divide(simd, delta.data() + lo, weight.data() + lo,
+          sigma.data() + lo, hi - lo);
+      /* Backward. */
+      assert(qfront == qback);
+      typedef typename VertexList::iterator VertexIterator;
+      auto sfront = std::reverse_iterator<VertexIterator>(qback),
+           sback = queue.rend();
+      while (sfront != sback) {
+        VertexId w = *sfront++;
+        assert(lo <= w && w < hi);
+        const VertexId dist_v = dist[w] - 1;
+        simd_select(simd, adj.data() + ptr[w], adj.data() + ptr[w + 1],
+            dist.data(), dist_v, dist_v, [&](const VertexId v) {
+            assert(lo <= v && v < hi);
+            delta[v] += delta[w];
+            });
+      }
+      /* Sum, the source is skipped. */
+      const auto bc_source = bc[source];
+      simd_accumulate(simd, bc.data() + lo, delta.data() + lo,
+          sigma.data() + lo, dist.data() + lo, hi - lo, scale);
+      bc[source] = bc_source;
+    }
 
   template<typename Return, typename VertexList>
     static inline Return bc_cpu_worker(
         const VertexList __pass__ ptr,
         const VertexList __pass__ adj,
         const Return __pass__ weight,
+        const VertexList __pass__ bounds,
         /* This sounds like a bug in stdlib++, I couldn't pass atomic by
          * reference to std::async task... */
-        std::atomic_int* source_dispatch
+        SourceDispatch<Return>* source_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      Return bc(n, 0.0f);
+      CPUSourceState<Return, VertexList> state(n);
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("cpu");
+      while ((source = source_dispatch->fetch()) < n) {
+        auto hi = std::upper_bound(bounds.begin(), bounds.end(), source);
+        bc_cpu_source(ptr, adj, weight, source, *(hi - 1), *hi,
+            weight[source], state, bc);
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_WORKER:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
+  /** Levels of a compact state are kept modulo kUnvisited, neighbours of a
+   * vertex lie at most one level apart so comparisons remain exact. */
+  template<typename Level> struct CompactLevel;
+
+  template<> struct CompactLevel<uint8_t> {
+    static const uint8_t kUnvisited = 0xff;
+  };
+
+  template<> struct CompactLevel<uint16_t> {
+    static const uint16_t kUnvisited = 0xffff;
+  };
+
+#if   COMPACT_STATE == 16
+  typedef uint16_t CompactStateLevel;
+#else
+  typedef uint8_t CompactStateLevel;
+#endif
+
+  /** Vertex ids of a compact state are local to the component of the
+   * source, the type bounds size of a component it can hold. */
+  template<typename Index> struct CompactIndex {
+    static const int64_t kMaxVertices = std::numeric_limits<Index>::max();
+  };
+
+  template<> struct CompactIndex<uint16_t> {
+    static const int64_t kMaxVertices = 1 << 16;
+  };
+
+  /** Per-source scratch space for components of up to kMaxVertices. Levels
+   * are read for every edge and get an array of their own, path counts and
+   * dependencies are read together for edges of the shortest paths DAG only
+   * and are interleaved. */
+  template<typename Result, typename Level, typename Index>
+    struct CompactState {
+      static const Level kUnvisited = CompactLevel<Level>::kUnvisited;
+      static const int64_t kMaxVertices = CompactIndex<Index>::kMaxVertices;
+
+      struct Paths {
+        SigmaInt sigma_;
+        Result delta_;
+      };
+
+      HugeVector<Level> level_;
+      HugeVector<Paths> paths_;
+      HugeVector<Index> queue_;
+
+      inline void reserve(const size_t k) {
+        assert(static_cast<int64_t>(k) <= kMaxVertices);
+        if (level_.size() < k) {
+          const Level unvisited = kUnvisited;
+          level_.resize(k, unvisited);
+          paths_.resize(k, Paths{0, 0});
+          queue_.resize(k);
+        }
+      }
+
+      static inline Level next(const Level level) {
+        return level + 1 == kUnvisited ? 0 : level + 1;
+      }
+    };
+
+  /** Same as bc_cpu_source for a source of component [lo, hi), which must
+   * be a contiguous range of vertices. */
+  template<typename Return, typename VertexList, typename Level,
+    typename Index>
+    static inline void bc_cpu_compact_source(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const Return __pass__ weight,
+        const typename VertexList::value_type source,
+        const typename VertexList::value_type lo,
+        const typename VertexList::value_type hi,
+        CompactState<typename Return::value_type, Level, Index> __pass__ state,
+        Return __pass__ bc
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef CompactState<typename Return::value_type, Level, Index> State;
+      state.reserve(hi - lo);
+      Level* const level = state.level_.data();
+      typename State::Paths* const paths = state.paths_.data();
+      Index* const queue = state.queue_.data();
+      const VertexId* const base = adj.data();
+      const Index s = source - lo;
+      Index *qfront = queue, *qback = queue;
+      /* Init source. */
+      level[s] = 0;
+      paths[s].sigma_ = 1;
+      *qback++ = s;
+      /* Forward. */
+      while (qfront != qback) {
+        const Index v = *qfront++;
+        const Level lw = State::next(level[v]);
+        const SigmaInt sv = paths[v].sigma_;
+        for (const VertexId *itadj = base + ptr[lo + v],
+            *itadjN = base + ptr[lo + v + 1]; itadj != itadjN; itadj++) {
+          const Index w = *itadj - lo;
+          assert(*itadj >= lo && *itadj < hi);
+          if (level[w] == State::kUnvisited) {
+            level[w] = lw;
+            *qback++ = w;
+          }
+          if (level[w] == lw) {
+            paths[w].sigma_ += sv;
+            assert(paths[w].sigma_ >= 0);
+          }
+        }
+      }
+      /* Intermediate. */
+      for (Index* it = queue; it != qback; it++) {
+        paths[*it].delta_ = weight[lo + *it] / paths[*it].sigma_;
+      }
+      /* Backward. */
+      for (Index* it = qback; it != queue;) {
+        const Index w = *--it;
+        const Level lw = level[w];
+        const typename Return::value_type dw = paths[w].delta_;
+        for (const VertexId *itadj = base + ptr[lo + w],
+            *itadjN = base + ptr[lo + w + 1]; itadj != itadjN; itadj++) {
+          const Index v = *itadj - lo;
+          if (State::next(level[v]) == lw) {
+            paths[v].delta_ += dw;
+          }
+        }
+      }
+      /* Sum and cleanup, every reached vertex is on the queue. */
+      const typename Return::value_type scale = weight[source];
+      for (Index* it = queue; it != qback; it++) {
+        const Index v = *it;
+        if (v != s) {
+          bc[lo + v] += (paths[v].delta_ * paths[v].sigma_ - 1) * scale;
+        }
+        level[v] = State::kUnvisited;
+        paths[v].sigma_ = 0;
+      }
+    }
+
+  /** Finds connected components, which are ranges of consecutive vertices
+   * in BFS order. Returns their boundaries, or a single range of all
+   * vertices if some component is not contiguous. */
+  template<typename VertexList>
+    static inline VertexList component_bounds(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      VertexList bounds(1, 0), queue(n);
+      std::vector<char> seen(n, 0);
+      for (VertexId root = 0; root < n; root++) {
+        if (seen[root]) {
+          continue;
+        }
+        if (root != bounds.back()) {
+          return VertexList({ 0, n });
+        }
+        auto qfront = queue.begin(), qback = qfront;
+        VertexId last = root;
+        seen[root] = 1;
+        *qback++ = root;
+        while (qfront != qback) {
+          const VertexId v = *qfront++;
+          last = std::max(last, v);
+          for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+            if (!seen[adj[i]]) {
+              seen[adj[i]] = 1;
+              *qback++ = adj[i];
+            }
+          }
+        }
+        if (last - root + 1 != qback - queue.begin()) {
+          return VertexList({ 0, n });
+        }
+        bounds.push_back(last + 1);
+      }
+      return bounds;
+    }
+
+  /** Same as bc_cpu_worker with compact state, components of up to 2^16
+   * vertices use 16-bit vertex ids. */
+  template<typename Return, typename VertexList, typename Level>
+    static inline Return bc_cpu_compact_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const Return __pass__ weight,
+        const VertexList __pass__ bounds,
+        SourceDispatch<Return>* source_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef typename Return::value_type Result;
+      const VertexId n = ptr.size() - 1;
+      Return bc(n, 0.0f);
+      CompactState<Result, Level, uint16_t> small;
+      CompactState<Result, Level, VertexId> big;
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("cpu");
+      while ((source = source_dispatch->fetch()) < n) {
+        auto hi = std::upper_bound(bounds.begin(), bounds.end(), source);
+        const VertexId lo = *(hi - 1);
+        if (*hi - lo <= small.kMaxVertices) {
+          bc_cpu_compact_source(ptr, adj, weight, source, lo, *hi, small, bc);
+        } else {
+          bc_cpu_compact_source(ptr, adj, weight, source, lo, *hi, big, bc);
+        }
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_WORKER:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
+  /** Betweenness counting only paths which end in targets, every vertex has
+   * unit weight. Traversal stops at the level of the last reached target and
+   * only reached vertices are visited afterwards. */
+  template<typename Return, typename VertexList>
+    static inline Return bc_cpu_restricted_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const std::vector<char> __pass__ targets,
+        SourceDispatch<Return>* source_dispatch
         ) {
       typedef typename VertexList::value_type VertexId;
       const VertexId n = ptr.size() - 1;
+      const VertexId target_count = std::count(targets.begin(), targets.end(),
+          1);
       Return bc(n, 0.0f), delta(n);
-      VertexList queue(n);
-      VertexList dist(n);
-      std::vector<SigmaInt> sigma(n);
+      VertexList queue(n), dist(n, -1);
+      HugeVector<SigmaInt> sigma(n, 0);
+      VertexList finished;
       VertexId source, processed_count = 0;
-      while ((source = (*source_dispatch)++) < n) {
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("cpu");
+      while ((source = source_dispatch->fetch()) < n) {
         auto qfront = queue.begin(), qback = qfront;
+        VertexId remaining = target_count - targets[source],
+                 stop_level = remaining > 0 ? n : 0;
         /* Init source. */
-        std::fill(dist.begin(), dist.end(), -1);
         dist[source] = 0;
-        std::fill(sigma.begin(), sigma.end(), 0);
         sigma[source] = 1;
         *qback++ = source;
         /* Forward. */
-        while (qfront != qback) {
+        while (qfront != qback && dist[*qfront] < stop_level) {
           VertexId v = *qfront++;
-          assert(v < n);
-          auto itadj = adj.begin() + ptr[v];
-          const auto itadjN = adj.begin() + ptr[v + 1];
-          while (itadj != itadjN) {
-            VertexId w = *itadj++;
-            assert(w < n);
+          for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+            VertexId w = adj[i];
             if (dist[w] < 0) {
               *qback++ = w;
               dist[w] = dist[v] + 1;
+              if (targets[w] && --remaining == 0) {
+                stop_level = dist[w];
+              }
             }
             if (dist[w] == dist[v] + 1) {
               sigma[w] += sigma[v];
@@ -57,40 +407,345 @@ namespace brandes {
           }
         }
         /* Intermediate. */
-        for (VertexId v = 0; v < n; v++) {
-          delta[v] = weight[v] / sigma[v];
+        for (auto it = queue.begin(); it != qback; it++) {
+          delta[*it] = targets[*it] / static_cast<float>(sigma[*it]);
         }
         /* Backward. */
-        assert(qfront == qback);
-        typedef typename VertexList::iterator VertexIterator;
-        auto sfront = std::reverse_iterator<VertexIterator>(qback),
-             sback = queue.rend();
-        while (sfront != sback) {
-          VertexId w = *sfront++;
-          assert(w < n);
-          auto itadj = adj.begin() + ptr[w];
-          const auto itadjN = adj.begin() + ptr[w + 1];
-          while (itadj != itadjN) {
-            VertexId v = *itadj++;
-            assert(v < n);
+        for (auto it = qback; it != queue.begin();) {
+          VertexId w = *--it;
+          if (delta[w] == 0) {
+            continue;
+          }
+          for (VertexId i = ptr[w], iN = ptr[w + 1]; i < iN; i++) {
+            VertexId v = adj[i];
             if (dist[w] == dist[v] + 1) {
               delta[v] += delta[w];
             }
           }
         }
-        /* Sum. */
-        for (VertexId v = 0; v < n; v++) {
-          if (v != source && dist[v] >= 0) {
-            bc[v] += (delta[v] * sigma[v] - 1) * weight[source];
+        /* Sum and cleanup of reached vertices. */
+        for (auto it = queue.begin(); it != qback; it++) {
+          VertexId v = *it;
+          if (v != source) {
+            bc[v] += delta[v] * sigma[v] - targets[v];
           }
+          dist[v] = -1;
+          sigma[v] = 0;
         }
+        source_dispatch->finished(slot, source, bc, finished);
         processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
       }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
       MICROPROF_INFO("CPU_WORKER:\tsources processed:\t%d\n", processed_count);
       return bc;
     }
 
+  /** Betweenness of unit weight vertices together with requested metrics
+   * of Metrics, computed from the same traversal of each source. Closeness
+   * and harmonic centrality of a source are set by whoever processes it,
+   * stress and edge betweenness are summed, the latter per adjacency slot. */
+  template<typename Return, typename VertexList>
+    static inline Return bc_cpu_metrics_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        SourceDispatch<Return>* source_dispatch,
+        Metrics* metrics
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      const unsigned requested = metrics->requested_;
+      Return bc(n, 0.0f), delta(n);
+      VertexList queue(n), dist(n, -1);
+      HugeVector<SigmaInt> sigma(n, 0);
+      /* Number of shortest paths from a vertex down to all vertices below. */
+      std::vector<double> paths(requested & Metrics::kStress ? n : 0);
+      if (requested & Metrics::kCloseness) {
+        metrics->closeness_.assign(n, 0.0);
+      }
+      if (requested & Metrics::kHarmonic) {
+        metrics->harmonic_.assign(n, 0.0);
+      }
+      if (requested & Metrics::kStress) {
+        metrics->stress_.assign(n, 0.0);
+      }
+      if (requested & Metrics::kEdge) {
+        metrics->edge_bc_.assign(adj.size(), 0.0);
+      }
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("cpu");
+      while ((source = source_dispatch->fetch()) < n) {
+        auto qfront = queue.begin(), qback = qfront;
+        double farness = 0.0, harmonic = 0.0;
+        /* Init source. */
+        dist[source] = 0;
+        sigma[source] = 1;
+        *qback++ = source;
+        /* Forward. */
+        while (qfront != qback) {
+          VertexId v = *qfront++;
+          if (v != source) {
+            farness += dist[v];
+            harmonic += 1.0 / dist[v];
+          }
+          for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+            VertexId w = adj[i];
+            if (dist[w] < 0) {
+              *qback++ = w;
+              dist[w] = dist[v] + 1;
+            }
+            if (dist[w] == dist[v] + 1) {
+              sigma[w] += sigma[v];
+              assert(sigma[w] >= 0);
+            }
+          }
+        }
+        if (requested & Metrics::kCloseness) {
+          const VertexId reached = qback - queue.begin();
+          metrics->closeness_[source] = farness > 0 ? (reached - 1) / farness
+            : 0.0;
+        }
+        if (requested & Metrics::kHarmonic) {
+          metrics->harmonic_[source] = harmonic;
+        }
+        /* Intermediate. */
+        for (auto it = queue.begin(); it != qback; it++) {
+          delta[*it] = 1.0f / sigma[*it];
+          if (requested & Metrics::kStress) {
+            paths[*it] = 0.0;
+          }
+        }
+        /* Backward, edge dependency of v-w equals sigma[v] * delta[w]. */
+        for (auto it = qback; it != queue.begin();) {
+          VertexId w = *--it;
+          for (VertexId i = ptr[w], iN = ptr[w + 1]; i < iN; i++) {
+            VertexId v = adj[i];
+            if (dist[w] == dist[v] + 1) {
+              delta[v] += delta[w];
+              if (requested & Metrics::kStress) {
+                paths[v] += 1.0 + paths[w];
+              }
+              if (requested & Metrics::kEdge) {
+                metrics->edge_bc_[i] += static_cast<double>(sigma[v]) *
+                  delta[w];
+              }
+            }
+          }
+        }
+        /* Sum and cleanup of reached vertices. */
+        for (auto it = queue.begin(); it != qback; it++) {
+          VertexId v = *it;
+          if (v != source) {
+            bc[v] += delta[v] * sigma[v] - 1;
+            if (requested & Metrics::kStress) {
+              metrics->stress_[v] += sigma[v] * paths[v];
+            }
+          }
+          dist[v] = -1;
+          sigma[v] = 0;
+        }
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_WORKER:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
+  /** Level-synchronous Brandes, threads of the pool work on the same source
+   * so that per-vertex state exists once regardless of their number.
+   * Vertices of the next level are claimed by compare-and-swap on distance,
+   * afterwards each vertex pulls path counts from its neighbours on the
+   * previous level and dependencies from those on the next one, so that no
+   * two threads write the same entry. */
+  template<typename Return, typename VertexList>
+    static inline Return bc_cpu_level_team(
+        WorkerPool* pool,
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const Return __pass__ weight,
+        SourceDispatch<Return>* source_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef typename Return::value_type Result;
+      const VertexId n = ptr.size() - 1;
+      const int64_t kGrain = 1 << 10;
+      Return bc(n, 0.0f), delta(n);
+      VertexList order(n), dist(n, -1);
+      HugeVector<SigmaInt> sigma(n, 0);
+      /* Level d occupies order[levels[d]] .. order[levels[d + 1] - 1]. */
+      std::vector<VertexId> levels;
+      std::atomic<VertexId> tail;
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("team");
+      while ((source = source_dispatch->fetch()) < n) {
+        /* Init source. */
+        dist[source] = 0;
+        sigma[source] = 1;
+        order[0] = source;
+        levels.assign(1, 0);
+        levels.push_back(1);
+        tail = 1;
+        /* Forward. */
+        for (VertexId d = 0; levels[d] < levels[d + 1]; d++) {
+          pool->parallel_for(levels[d], levels[d + 1], kGrain,
+              [&](int64_t lo, int64_t hi) {
+              VertexList found;
+              for (int64_t i = lo; i < hi; i++) {
+                const VertexId v = order[i];
+                for (VertexId j = ptr[v], jN = ptr[v + 1]; j < jN; j++) {
+                  const VertexId w = adj[j];
+                  VertexId unseen = -1;
+                  if (__atomic_load_n(&dist[w], __ATOMIC_RELAXED) < 0 &&
+                      __atomic_compare_exchange_n(&dist[w], &unseen, d + 1,
+                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    found.push_back(w);
+                  }
+                }
+              }
+              const VertexId at = tail.fetch_add(found.size());
+              std::copy(found.begin(), found.end(), order.begin() + at);
+              });
+          levels.push_back(tail);
+          pool->parallel_for(levels[d + 1], levels[d + 2], kGrain,
+              [&](int64_t lo, int64_t hi) {
+              for (int64_t i = lo; i < hi; i++) {
+                const VertexId w = order[i];
+                SigmaInt paths = 0;
+                for (VertexId j = ptr[w], jN = ptr[w + 1]; j < jN; j++) {
+                  if (dist[adj[j]] == d) {
+                    paths += sigma[adj[j]];
+                  }
+                }
+                assert(paths > 0);
+                sigma[w] = paths;
+              }
+              });
+        }
+        /* Intermediate and backward, the last level is empty. */
+        for (VertexId d = levels.size() - 3; d >= 0; d--) {
+          pool->parallel_for(levels[d], levels[d + 1], kGrain,
+              [&](int64_t lo, int64_t hi) {
+              for (int64_t i = lo; i < hi; i++) {
+                const VertexId v = order[i];
+                Result dependency = weight[v] / sigma[v];
+                for (VertexId j = ptr[v], jN = ptr[v + 1]; j < jN; j++) {
+                  if (dist[adj[j]] == d + 1) {
+                    dependency += delta[adj[j]];
+                  }
+                }
+                delta[v] = dependency;
+              }
+              });
+        }
+        /* Sum and cleanup of reached vertices. */
+        const Result scale = weight[source];
+        pool->parallel_for(0, levels.back(), kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (int64_t i = lo; i < hi; i++) {
+              const VertexId v = order[i];
+              if (v != source) {
+                bc[v] += (delta[v] * sigma[v] - 1) * scale;
+              }
+              dist[v] = -1;
+              sigma[v] = 0;
+            }
+            });
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_TEAM:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
   template<typename Cont> struct cpu_driver {
+    template<typename Return>
+      static inline void combine(
+          Return __pass__ bc,
+          WorkerTree<Return> __pass__ cpu_jobs
+          ) {
+        MICROPROF_START(cpu_driver_combine);
+        if (cpu_jobs.size() > 0) {
+          auto bc1 = cpu_jobs.sum();
+          assert(bc.size() == bc1.size());
+          auto itbc = bc.begin(),
+               itbc1 = bc1.begin();
+          const auto itbcN = bc.end();
+          while (itbc != itbcN) {
+            *itbc++ += *itbc1++;
+          }
+        }
+        MICROPROF_END(cpu_driver_combine);
+      }
+
+    /* Sums metrics of all workers, edge scores of both directions of an
+     * edge are merged. */
+    template<typename VertexList>
+      static inline void combine_metrics(
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          Metrics __pass__ total,
+          std::vector<Metrics> __pass__ parts
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        const unsigned requested = total.requested_;
+        std::vector<double> Metrics::* scores[] = { &Metrics::closeness_,
+          &Metrics::harmonic_, &Metrics::stress_ };
+        const unsigned flags[] = { Metrics::kCloseness, Metrics::kHarmonic,
+          Metrics::kStress };
+        for (int k = 0; k < 3; k++) {
+          if (requested & flags[k]) {
+            std::vector<double>& score = total.*scores[k];
+            score.assign(n, 0.0);
+            for (auto& part : parts) {
+              for (VertexId v = 0; v < n; v++) {
+                score[v] += (part.*scores[k])[v];
+              }
+            }
+          }
+        }
+        total.edges_.clear();
+        total.edge_bc_.clear();
+        if (requested & Metrics::kEdge) {
+          std::vector<std::pair<std::pair<int, int>, double>> edges;
+          for (VertexId v = 0; v < n; v++) {
+            for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+              double score = 0.0;
+              for (auto& part : parts) {
+                score += part.edge_bc_[i];
+              }
+              const VertexId w = adj[i];
+              edges.push_back(std::make_pair(std::make_pair(std::min(v, w),
+                      std::max(v, w)), score));
+            }
+          }
+          std::sort(edges.begin(), edges.end());
+          for (auto& e : edges) {
+            if (total.edges_.empty() || total.edges_.back() != e.first) {
+              total.edges_.push_back(e.first);
+              total.edge_bc_.push_back(0.0);
+            }
+            total.edge_bc_.back() += e.second;
+          }
+        }
+      }
+
     template<typename Return, typename VertexList>
       inline Return cont(
           Context& ctx,
@@ -101,37 +756,171 @@ namespace brandes {
         typedef typename VertexList::value_type VertexId;
         assert(ctx.kUseGPU_ || ctx.kCPUJobs_ > 0);
         MICROPROF_INFO("CONFIGURATION:\tshould use GPU\t%d\n", ctx.kUseGPU_);
+        MICROMEM_BEGIN(betweenness);
         MICROPROF_INFO("CONFIGURATION:\tCPU jobs count\t%d\n", ctx.kCPUJobs_);
+        MICROPROF_INFO("CONFIGURATION:\tSIMD kernels\t%s\n",
+            simd_name(simd_level()));
         const VertexId n = ptr.size() - 1;
-        std::atomic_int source_dispatch(0);
-        MICROPROF_WARN(!source_dispatch.is_lock_free(),
+        uint64_t key = fingerprint(fingerprint(fingerprint(
+                fingerprint(), ptr), adj), weight);
+        key = fingerprint(fingerprint(key, ctx.sources_mask_),
+            ctx.targets_mask_);
+        ReduceGroup group(ctx);
+        /* Checkpoints hold betweenness only. */
+        MICROPROF_WARN(ctx.checkpoint_path_ && ctx.metrics_.requested_,
+            "Checkpoints are disabled when computing additional metrics.");
+        SourceDispatch<Return> source_dispatch(n, ctx.metrics_.requested_ ?
+            nullptr : ctx.checkpoint_path_, ctx.checkpoint_interval_, key,
+            ctx.rank_, ctx.ranks_);
+        MICROPROF_WARN(!source_dispatch.next_.is_lock_free(),
             "Atomic integer is not lock free.");
-        std::vector<std::future<Return>> cpu_jobs;
+        if (!ctx.sources_mask_.empty()) {
+          source_dispatch.restrict_sources(ctx.sources_mask_);
+        }
+        /* Kernels count paths to all vertices and compute nothing but
+         * betweenness. */
+        const bool targeted = !ctx.targets_mask_.empty();
+        const bool metered = ctx.metrics_.requested_ != 0;
+        assert(!targeted || !metered);
+        const bool use_gpu = ctx.kUseGPU_ && !targeted && !metered;
+        MICROPROF_WARN(ctx.kUseGPU_ && targeted,
+            "Restricted targets are handled by CPU only.");
+        MICROPROF_WARN(ctx.kUseGPU_ && metered,
+            "Additional metrics are computed by CPU only.");
+        const int jobs_count = use_gpu ? ctx.kCPUJobs_
+          : std::max(ctx.kCPUJobs_, 1);
+        /* Workers share a source if their own state would not fit. */
+        const int64_t state_bytes = static_cast<int64_t>(n) * (2 *
+            sizeof(typename Return::value_type) + 2 * sizeof(VertexId) +
+            sizeof(SigmaInt));
+        const bool level_team = !targeted && !metered && jobs_count > 1 &&
+          jobs_count * state_bytes > ctx.state_budget();
+        MICROPROF_INFO("CONFIGURATION:\tlevel-synchronous team\t%d\n",
+            level_team);
+        /* Per-source state of workers is reset and summed over the
+         * component of the source only, the device runs sources of
+         * different components together. */
+        const VertexList bounds = (!level_team || use_gpu) && !metered &&
+          !targeted ? component_bounds(ptr, adj) : VertexList();
+        if (use_gpu && bounds.size() > 2) {
+          source_dispatch.interleave(bounds);
+        }
+        std::unique_ptr<StatusFile<Return>> status(ctx.status_path_ ?
+            new StatusFile<Return>(source_dispatch, ctx.status_path_,
+              ctx.status_interval_, adj.size() / 2) : nullptr);
+        /* Workers read graph and weights from replicas on their nodes, unless
+         * memory is short. */
+        const int nodes = level_team || ctx.low_memory_ ? 1
+          : ctx.pool().nodes();
+        NodeReplicas<VertexList> ptrs(ptr, nodes), adjs(adj, nodes);
+        NodeReplicas<Return> weights(weight, nodes);
+        NodeReplicas<std::vector<char>> targets(ctx.targets_mask_, nodes);
+        std::vector<Metrics> metrics(metered ? jobs_count : 0,
+            ctx.metrics_);
         MICROPROF_START(cpu_scheduling);
-        for (int i = 0; i < ctx.kCPUJobs_; i++) {
-          cpu_jobs.push_back(std::async(std::launch::async,
-                brandes::bc_cpu_worker<Return, VertexList>,
-                ptr, adj, weight, &source_dispatch));
+        WorkerTree<Return> cpu_jobs(ctx.pool(), level_team ? 1 : jobs_count,
+            [&](const int node, const int i) -> Return {
+            if (level_team) {
+              return bc_cpu_level_team<Return, VertexList>(&ctx.pool(), ptr,
+                adj, weight, &source_dispatch);
+            } else if (metered) {
+              return bc_cpu_metrics_worker<Return, VertexList>(ptrs.get(node),
+                adjs.get(node), &source_dispatch, &metrics[i]);
+            } else if (targeted) {
+              return bc_cpu_restricted_worker<Return, VertexList>(
+                ptrs.get(node), adjs.get(node), targets.get(node),
+                &source_dispatch);
+            }
+            if (COMPACT_STATE) {
+              return bc_cpu_compact_worker<Return, VertexList,
+                     CompactStateLevel>(ptrs.get(node), adjs.get(node),
+                       weights.get(node), bounds, &source_dispatch);
+            }
+            return bc_cpu_worker<Return, VertexList>(ptrs.get(node),
+                adjs.get(node), weights.get(node), bounds, &source_dispatch);
+            });
+        MICROPROF_END(cpu_scheduling);
+        Return bc = use_gpu
+          ? CONT_BIND(ctx, ptr, adj, weight, source_dispatch)
+          : Return(n, 0.0f);
+        if (!use_gpu) {
+          fprintf(stderr, "0\n0\n");
+        }
+        combine(bc, cpu_jobs);
+        status.reset();
+        source_dispatch.complete(bc);
+        group.allreduce(ctx, bc, key);
+        if (metered) {
+          combine_metrics(ptr, adj, ctx.metrics_, metrics);
+          group.allreduce(ctx, ctx.metrics_.closeness_, key);
+          group.allreduce(ctx, ctx.metrics_.harmonic_, key);
+          group.allreduce(ctx, ctx.metrics_.stress_, key);
+          group.allreduce(ctx, ctx.metrics_.edge_bc_, key);
         }
+        MICROMEM_END(betweenness);
+        return bc;
+      }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const LengthList __pass__ len,
+          const Return __pass__ weight
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        assert(ctx.kUseGPU_ || ctx.kCPUJobs_ > 0);
+        MICROPROF_INFO("CONFIGURATION:\tshould use GPU\t%d\n", ctx.kUseGPU_);
+        MICROMEM_BEGIN(betweenness);
+        MICROPROF_INFO("CONFIGURATION:\tCPU jobs count\t%d\n", ctx.kCPUJobs_);
+        const VertexId n = ptr.size() - 1;
+        const auto delta = sssp_delta(ctx, len);
+        MICROPROF_INFO("CONFIGURATION:\tSSSP delta\t%f\n",
+            static_cast<double>(delta));
+        uint64_t key = fingerprint(fingerprint(fingerprint(
+                fingerprint(fingerprint(), ptr), adj), len), weight);
+        key = fingerprint(key, ctx.sources_mask_);
+        ReduceGroup group(ctx);
+        SourceDispatch<Return> source_dispatch(n, ctx.checkpoint_path_,
+            ctx.checkpoint_interval_, key, ctx.rank_, ctx.ranks_);
+        assert(ctx.targets_mask_.empty() && !ctx.metrics_.requested_);
+        if (!ctx.sources_mask_.empty()) {
+          source_dispatch.restrict_sources(ctx.sources_mask_);
+        }
+        std::unique_ptr<StatusFile<Return>> status(ctx.status_path_ ?
+            new StatusFile<Return>(source_dispatch, ctx.status_path_,
+              ctx.status_interval_, adj.size() / 2) : nullptr);
+        /* Big graphs get one team which parallelizes each source, the team
+         * spans all nodes and reads the original graph. */
+        const bool team = ctx.kCPUJobs_ > 1 && n >= ctx.kTeamMinN_;
+        const int nodes = team || ctx.low_memory_ ? 1 : ctx.pool().nodes();
+        NodeReplicas<VertexList> ptrs(ptr, nodes), adjs(adj, nodes);
+        NodeReplicas<LengthList> lens(len, nodes);
+        NodeReplicas<Return> weights(weight, nodes);
+        MICROPROF_START(cpu_scheduling);
+        WorkerTree<Return> cpu_jobs(ctx.pool(), team ? 1 : ctx.kCPUJobs_,
+            [&](const int node, const int) -> Return {
+            if (team) {
+              return bc_cpu_delta_team<Return, VertexList, LengthList>(
+                &ctx.pool(), ptr, adj, len, weight, &source_dispatch, delta);
+            }
+            return bc_cpu_dijkstra_worker<Return, VertexList, LengthList>(
+                ptrs.get(node), adjs.get(node), lens.get(node),
+                weights.get(node), &source_dispatch);
+            });
         MICROPROF_END(cpu_scheduling);
         Return bc = ctx.kUseGPU_
-          ? CONT_BIND(ctx, ptr, adj, weight, source_dispatch)
+          ? CONT_BIND(ctx, ptr, adj, len, weight, source_dispatch)
           : Return(n, 0.0f);
         if (!ctx.kUseGPU_) {
           fprintf(stderr, "0\n0\n");
         }
-        MICROPROF_START(cpu_driver_combine);
-        for (auto& cpu_job : cpu_jobs) {
-          auto bc1  = cpu_job.get();
-          assert(bc.size() == bc1.size());
-          auto itbc = bc.begin(),
-               itbc1 = bc1.begin();
-          const auto itbcN = bc.end();
-          while (itbc != itbcN) {
-            *itbc++ += *itbc1++;
-          }
-        }
-        MICROPROF_END(cpu_driver_combine);
+        combine(bc, cpu_jobs);
+        status.reset();
+        source_dispatch.complete(bc);
+        group.allreduce(ctx, bc, key);
+        MICROMEM_END(betweenness);
         return bc;
       }
   };
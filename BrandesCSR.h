@@ -3,49 +3,253 @@
 #define BRANDESCSR_H_
 
 #include <cassert>
+#include <cstdio>
+#include <cstdint>
 #include <vector>
+#include <atomic>
+#include <utility>
+#include <algorithm>
 
 #include "./BrandesCOO.h"
 
 namespace brandes {
 
+  /** Builds CSR of edges, the functor is called with (slot, edge, end) for
+   * every slot of adj, where end is 1 if the slot lists v1_ of the edge.
+   * Neighbours of a vertex are listed in no particular order unless a single
+   * thread fills them, then they follow the order of edges. */
+  template<typename VertexList, typename EdgeList, typename Fill>
+    static inline void csr_scatter(
+        WorkerPool __pass__ pool,
+        const typename VertexList::value_type n,
+        const EdgeList __pass__ E,
+        VertexList __pass__ ptr,
+        VertexList __pass__ adj,
+        Fill fill
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const int64_t m = E.size();
+      ptr.assign(n + 1, 0);
+      adj.resize(2 * m);
+      pool.parallel_for(0, m, WorkerPool::kGrain, [&](int64_t lo, int64_t hi) {
+          for (int64_t k = lo; k < hi; k++) {
+            __atomic_fetch_add(&ptr[E[k].v1_], 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ptr[E[k].v2_], 1, __ATOMIC_RELAXED);
+          }
+          });
+      assert(!ptr.empty());
+      const VertexId sum = pool.exclusive_scan(ptr.begin(), ptr.end());
+      assert((size_t) sum == 2 * E.size());
+      SUPPRESS_UNUSED(sum);
+      VertexList alloc(n, 0);
+      if (pool.size() == 1) {
+        for (int64_t k = 0; k < m; k++) {
+          const VertexId v1 = E[k].v1_, v2 = E[k].v2_;
+          fill(ptr[v1] + alloc[v1]++, k, 0);
+          fill(ptr[v2] + alloc[v2]++, k, 1);
+        }
+        return;
+      }
+      pool.parallel_for(0, m, WorkerPool::kGrain, [&](int64_t lo, int64_t hi) {
+          for (int64_t k = lo; k < hi; k++) {
+            const VertexId v1 = E[k].v1_, v2 = E[k].v2_;
+            fill(ptr[v1] + __atomic_fetch_add(&alloc[v1], 1, __ATOMIC_RELAXED),
+                k, 0);
+            fill(ptr[v2] + __atomic_fetch_add(&alloc[v2], 1, __ATOMIC_RELAXED),
+                k, 1);
+          }
+          });
+#ifndef NDEBUG
+      for (VertexId i = 0; i < n; i++) {
+        assert(alloc[i] == ptr[i + 1] - ptr[i]);
+      }
+#endif  // NDEBUG
+    }
+
+  /* Sorts neighbours of v and moves distinct ones, other than v itself, to
+   * the front of its range, returns their count. */
+  template<typename VertexList>
+    static inline typename VertexList::value_type csr_unique(
+        const typename VertexList::value_type v,
+        const VertexList __pass__ ptr,
+        VertexList __pass__ adj,
+        int64_t __pass__ loops
+        ) {
+      auto first = adj.begin() + ptr[v], last = adj.begin() + ptr[v + 1];
+      if (!std::is_sorted(first, last)) {
+        std::sort(first, last);
+      }
+      auto out = first;
+      for (auto it = first; it != last; it++) {
+        if (*it == v) {
+          loops++;
+        } else if (out == first || *(out - 1) != *it) {
+          *out++ = *it;
+        }
+      }
+      return out - first;
+    }
+
+  /* As above, of parallel edges the shortest one is kept. */
+  template<typename VertexList, typename LengthList>
+    static inline typename VertexList::value_type csr_unique(
+        const typename VertexList::value_type v,
+        const VertexList __pass__ ptr,
+        VertexList __pass__ adj,
+        LengthList __pass__ len,
+        int64_t __pass__ loops,
+        std::vector<std::pair<typename VertexList::value_type,
+          typename LengthList::value_type>> __pass__ buf
+        ) {
+      buf.clear();
+      for (auto i = ptr[v]; i < ptr[v + 1]; i++) {
+        buf.push_back(std::make_pair(adj[i], len[i]));
+      }
+      std::sort(buf.begin(), buf.end());
+      auto out = ptr[v];
+      for (auto it = buf.begin(); it != buf.end(); it++) {
+        if (it->first == v) {
+          loops++;
+        } else if (out == ptr[v] || adj[out - 1] != it->first) {
+          adj[out] = it->first;
+          len[out++] = it->second;
+        }
+      }
+      return out - ptr[v];
+    }
+
+  /* Moves kept prefixes of ranges given by ptr to ranges given by ptr1, in
+   * place (serially, ranges only move towards the front) or through a copy
+   * filled in parallel. */
+  template<typename VertexList, typename List>
+    static inline void csr_compact(
+        WorkerPool __pass__ pool,
+        const bool in_place,
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ ptr1,
+        List __pass__ lst
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      if (in_place) {
+        for (VertexId v = 0; v < n; v++) {
+          std::copy(lst.begin() + ptr[v],
+              lst.begin() + ptr[v] + ptr1[v + 1] - ptr1[v],
+              lst.begin() + ptr1[v]);
+        }
+        lst.resize(ptr1[n]);
+        return;
+      }
+      List lst1(ptr1[n]);
+      pool.parallel_for(0, n, WorkerPool::kGrain, [&](int64_t lo, int64_t hi) {
+          for (int64_t v = lo; v < hi; v++) {
+            std::copy(lst.begin() + ptr[v],
+                lst.begin() + ptr[v] + ptr1[v + 1] - ptr1[v],
+                lst1.begin() + ptr1[v]);
+          }
+          });
+      lst.swap(lst1);
+    }
+
+  /** Leaves sorted neighbours of every vertex without self-loops and
+   * repeated neighbours, unique(v, loops) is expected to sort neighbours of
+   * v, keep the distinct ones in front and count self-loop entries. Removed
+   * edges are reported on stderr in every build. */
+  template<typename VertexList, typename Unique, typename... Lists>
+    static inline void csr_simplify(
+        Context& ctx,
+        VertexList __pass__ ptr,
+        Unique unique,
+        Lists&... lists
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      VertexList ptr1(n + 1);
+      ptr1[n] = 0;
+      std::atomic<int64_t> loops(0);
+      ctx.pool().parallel_for(0, n, WorkerPool::kGrain,
+          [&](int64_t lo, int64_t hi) {
+          int64_t chunk_loops = 0;
+          for (int64_t v = lo; v < hi; v++) {
+            ptr1[v] = unique(v, chunk_loops);
+          }
+          loops += chunk_loops;
+          });
+      const int64_t kept = ctx.pool().exclusive_scan(ptr1.begin(), ptr1.end());
+      const int64_t removed = ptr[n] - kept;
+      MICROPROF_INFO("GRAPH:\tself-loops removed\t%lld\n",
+          static_cast<long long>(loops / 2));
+      MICROPROF_INFO("GRAPH:\tduplicate edges removed\t%lld\n",
+          static_cast<long long>((removed - loops) / 2));
+      if (removed == 0) {
+        return;
+      }
+      fprintf(stderr, "Removed %lld self-loops and %lld duplicate edges.\n",
+          static_cast<long long>(loops / 2),
+          static_cast<long long>((removed - loops) / 2));
+      const bool in_place = ctx.low_memory_ || ctx.pool().size() == 1;
+      const int compacted[] = {
+        (csr_compact(ctx.pool(), in_place, ptr, ptr1, lists), 0)...
+      };
+      SUPPRESS_UNUSED(compacted);
+      ptr.swap(ptr1);
+    }
+
   template<typename Cont> struct csr_create {
     template<typename Return, typename VertexId, typename EdgeList>
       inline Return cont(
           Context& ctx,
           const VertexId n,
-          const EdgeList __pass__ E
+          EdgeList __pass__ E
           ) const {
-        typedef std::vector<VertexId> VertexList;
+        typedef RawVector<VertexId> VertexList;
         MICROPROF_START(adjacency);
-        VertexList ptr(n + 1), adj(2 * E.size());
-        for (auto e : E) {
-          ptr[e.v1_]++;
-          ptr[e.v2_]++;
-        }
-        assert(!ptr.empty());
-        VertexId sum = 0;
-        for (auto& d : ptr) {
-          VertexId tmp = d;
-          d = sum;
-          sum += tmp;
-        }
-        assert((size_t) sum == 2 * E.size());
-        VertexList alloc(n);
-        for (auto e : E) {
-          adj[ptr[e.v1_] + alloc[e.v1_]++] = e.v2_;
-          adj[ptr[e.v2_] + alloc[e.v2_]++] = e.v1_;
-        }
-#ifndef NDEBUG
-        for (VertexId i = 0; i < n; i++) {
-          assert(alloc[i] == ptr[i + 1] - ptr[i]);
-        }
-#endif  // NDEBUG
+        MICROMEM_BEGIN(adjacency);
+        VertexList ptr, adj;
+        csr_scatter(ctx.pool(), n, E, ptr, adj,
+            [&](int64_t i, int64_t k, int end) {
+            adj[i] = end ? E[k].v1_ : E[k].v2_;
+            });
+        release(ctx, E);
+        csr_simplify(ctx, ptr, [&](VertexId v, int64_t& loops) {
+            return csr_unique(v, ptr, adj, loops);
+            }, adj);
+        MICROMEM_END(adjacency);
         MICROPROF_END(adjacency);
         return CONT_BIND(ctx, ptr, adj);
       }
   };
 
+  template<typename Cont> struct wcsr_create {
+    template<typename Return, typename VertexId, typename EdgeList>
+      inline Return cont(
+          Context& ctx,
+          const VertexId n,
+          EdgeList __pass__ E
+          ) const {
+        typedef RawVector<VertexId> VertexList;
+        typedef std::vector<typename EdgeList::value_type::Length> LengthList;
+        MICROPROF_START(adjacency);
+        MICROMEM_BEGIN(adjacency);
+        VertexList ptr, adj;
+        LengthList len(2 * E.size());
+        csr_scatter(ctx.pool(), n, E, ptr, adj,
+            [&](int64_t i, int64_t k, int end) {
+            len[i] = E[k].len_;
+            adj[i] = end ? E[k].v1_ : E[k].v2_;
+            });
+        release(ctx, E);
+        csr_simplify(ctx, ptr, [&](VertexId v, int64_t& loops) {
+            thread_local std::vector<std::pair<VertexId,
+              typename LengthList::value_type>> buf;
+            return csr_unique(v, ptr, adj, len, loops, buf);
+            }, adj, len);
+        MICROMEM_END(adjacency);
+        MICROPROF_END(adjacency);
+        return CONT_BIND(ctx, ptr, adj, len);
+      }
+  };
+
 }  // namespace brandes
 
 #endif  // BRANDESCSR_H_
@@ -0,0 +1,401 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESCHECKPOINT_H_
+#define BRANDESCHECKPOINT_H_
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include "./BrandesDEG1.h"
+
+#define CHECKPOINT_MAGIC "BRANDES1"
+
+namespace brandes {
+
+  /** FNV-1a over contents of a list, used to tell whether a checkpoint was
+   * taken for the very same (preprocessed) graph. */
+  template<typename List>
+    inline uint64_t fingerprint(uint64_t hash, const List __pass__ lst) {
+      const unsigned char* data =
+        reinterpret_cast<const unsigned char*>(lst.data());
+      const size_t size = lst.size() * sizeof(typename List::value_type);
+      for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+      }
+      return (hash ^ size) * 1099511628211ULL;
+    }
+
+  inline uint64_t fingerprint() {
+    return 14695981039346656037ULL;
+  }
+
+  /** Set asynchronously (e.g. from a signal handler) to stop handing out
+   * sources, workers finish their current ones and results are partial. */
+  inline std::atomic<bool>& cancellation() {
+    static std::atomic<bool> cancelled(false);
+    return cancelled;
+  }
+
+  /** Hands out sources to workers, every stride-th source (of the restricted
+   * list if given) starting from offset belongs to this process. When
+   * checkpointing is enabled, the first worker which notices that a
+   * checkpoint is due opens a new epoch, every worker moves its partial
+   * results here once per epoch and the accumulator, which always matches
+   * the set of finished sources, is saved when the last one has.
+   * Checkpoints of a partitioned run are kept per rank, in the given path
+   * followed by ".rank". Workers enroll to have their progress counted. */
+  template<typename Return> struct SourceDispatch {
+    typedef typename Return::value_type Result;
+    std::atomic_int next_;
+    const int kN_;
+    const int kOffset_;
+    const int kStride_;
+    /* Restricted or interleaved sources, used only if listed_. */
+    std::vector<int> list_;
+    bool listed_;
+    /* Boundaries of components whose sources are interleaved, empty unless
+     * interleave() was called. */
+    std::vector<int> bounds_;
+    const std::string file_;
+    const char* const kPath_;
+    const MicroBenchClock::duration kInterval_;
+    const uint64_t kKey_;
+    /* Sources finished in a previous run, read-only once resumed. */
+    std::vector<char> skip_;
+    std::mutex mutex_;
+    std::vector<char> done_;
+    Return bc_;
+    std::atomic<int64_t> due_at_;
+    /* Epochs opened and saved, an epoch is open while they differ. */
+    std::atomic<int64_t> epoch_;
+    std::atomic<int64_t> saved_;
+    /* Last epoch each worker deposited in, guarded by mutex_ as are counts
+     * of workers which did not leave and of those the open epoch waits for. */
+    std::vector<int64_t> deposited_;
+    int active_;
+    int waiting_;
+    /* Progress of enrolled workers, the last slot is shared on overflow. */
+    static const int kMaxWorkers = 64;
+    std::atomic<int> workers_;
+    std::atomic<const char*> kinds_[kMaxWorkers];
+    std::atomic<int64_t> done_by_[kMaxWorkers];
+
+    SourceDispatch(
+        int n,
+        const char* path,
+        double interval,
+        uint64_t key,
+        int offset = 0,
+        int stride = 1
+        ) :
+      next_(0),
+      kN_(n),
+      kOffset_(offset),
+      kStride_(stride),
+      listed_(false),
+      file_(path && stride > 1 ? std::string(path) + "." +
+          std::to_string(offset) : std::string(path ? path : "")),
+      kPath_(path ? file_.c_str() : nullptr),
+      kInterval_(std::chrono::duration_cast<MicroBenchClock::duration>(
+            std::chrono::duration<double>(interval))),
+      /* A partial sum belongs to one partition only. */
+      kKey_(fingerprint(key, std::vector<int>{offset, stride})),
+      done_(path ? n : 0, 0),
+      bc_(path ? n : 0, 0.0f),
+      due_at_((MicroBenchClock::now() + kInterval_).time_since_epoch().count()),
+      epoch_(0),
+      saved_(0),
+      active_(0),
+      waiting_(0),
+      workers_(0)
+    {
+      for (int w = 0; w < kMaxWorkers; w++) {
+        kinds_[w] = nullptr;
+        done_by_[w] = 0;
+      }
+      if (kPath_) {
+        resume();
+      }
+    }
+
+    inline int fetch() {
+      if (cancellation().load(std::memory_order_relaxed)) {
+        return kN_;
+      }
+      int source = next(next_++);
+      if (!skip_.empty()) {
+        while (source < kN_ && skip_[source]) {
+          source = next(next_++);
+        }
+      }
+      return source;
+    }
+
+    inline int next(const int64_t index) const {
+      const int64_t source = kOffset_ + index * kStride_;
+      if (listed_) {
+        return source < static_cast<int64_t>(list_.size()) ? list_[source]
+          : kN_;
+      }
+      return source < kN_ ? source : kN_;
+    }
+
+    /** Sources of this process which remain after resuming. */
+    inline int64_t total() const {
+      int64_t count = 0;
+      for (int64_t index = 0, source; (source = next(index)) < kN_; index++) {
+        count += skip_.empty() || !skip_[source];
+      }
+      return count;
+    }
+
+    /** Returns id of a new worker of given kind. A worker which joins
+     * while an epoch is open deposits from the next one on. */
+    inline int enroll(const char* kind) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const int id = workers_++;
+      kinds_[std::min(id, kMaxWorkers - 1)] = kind;
+      deposited_.push_back(epoch_);
+      active_++;
+      return id;
+    }
+
+    inline void progress(const int id) {
+      done_by_[std::min(id, kMaxWorkers - 1)].fetch_add(1,
+          std::memory_order_relaxed);
+    }
+
+    inline int64_t done() const {
+      int64_t count = 0;
+      for (int w = 0, wN = std::min<int>(workers_, kMaxWorkers); w < wN; w++) {
+        count += done_by_[w];
+      }
+      return count;
+    }
+
+    /** Limits dispatch to vertices set in mask, must precede fetching. */
+    inline void restrict_sources(const std::vector<char> __pass__ mask) {
+      assert(mask.size() == static_cast<size_t>(kN_));
+      list_.clear();
+      for (int v = 0; v < kN_; v++) {
+        if (mask[v]) {
+          list_.push_back(v);
+        }
+      }
+      listed_ = true;
+    }
+
+    /** Hands out sources of components given by their boundaries in turn,
+     * the k-th source of every component before the (k+1)-th of any, so
+     * that sources fetched one after another can run together. Must follow
+     * restrict_sources() and precede fetching. */
+    template<typename VertexList>
+      inline void interleave(const VertexList __pass__ bounds) {
+        bounds_.assign(bounds.begin(), bounds.end());
+        if (!listed_) {
+          list_.resize(kN_);
+          for (int v = 0; v < kN_; v++) {
+            list_[v] = v;
+          }
+          listed_ = true;
+        }
+        /* Rank of every source within its component, sources keep their
+         * order among those of the same rank. */
+        std::vector<int> seen(bounds_.size() - 1, 0);
+        std::vector<std::pair<int, int>> ranked;
+        ranked.reserve(list_.size());
+        for (const int v : list_) {
+          ranked.push_back(std::make_pair(seen[component(v)]++, v));
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+            [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+            return a.first < b.first;
+            });
+        for (size_t i = 0; i < ranked.size(); i++) {
+          list_[i] = ranked[i].second;
+        }
+      }
+
+    /** Component of a vertex among those given to interleave(). */
+    inline int component(const int v) const {
+      return std::upper_bound(bounds_.begin(), bounds_.end(), v) -
+        bounds_.begin() - 1;
+    }
+
+    inline bool due() const {
+      return MicroBenchClock::now().time_since_epoch().count() >= due_at_;
+    }
+
+    /** Whether given worker is to deposit its partial results, opens a new
+     * epoch if a checkpoint is due. */
+    inline bool owes(const int id) {
+      if (!kPath_ || (epoch_ == saved_ && !due())) {
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (epoch_ == saved_ && due()) {
+        epoch_++;
+        waiting_ = active_;
+        due_at_ = (MicroBenchClock::now() + kInterval_).time_since_epoch()
+          .count();
+      }
+      return deposited_[id] < epoch_;
+    }
+
+    /** Records finished source, moves partial results if the worker owes
+     * them. */
+    template<typename Accumulator, typename VertexList>
+      inline void finished(
+          const int id,
+          const int source,
+          Accumulator __pass__ bc,
+          VertexList __pass__ sources
+          ) {
+        if (kPath_) {
+          sources.push_back(source);
+          if (owes(id)) {
+            deposit(id, bc, sources, false);
+          }
+        }
+      }
+
+    /** Moves partial results of a worker, which leaves unless told
+     * otherwise. */
+    template<typename Accumulator, typename VertexList>
+      inline void deposit(
+          const int id,
+          Accumulator __pass__ bc,
+          VertexList __pass__ sources,
+          const bool leaving = true
+          ) {
+        if (!kPath_) {
+          return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(bc.size() == bc_.size());
+        for (int v = 0; v < kN_; v++) {
+          bc_[v] += bc[v];
+          bc[v] = 0;
+        }
+        for (auto source : sources) {
+          done_[source] = 1;
+        }
+        sources.clear();
+        if (deposited_[id] < epoch_) {
+          deposited_[id] = epoch_;
+          waiting_--;
+        }
+        active_ -= leaving;
+        if (epoch_ != saved_ && waiting_ == 0) {
+          save();
+          saved_ = epoch_.load();
+        }
+      }
+
+    /** Adds saved contributions to the final result and stores it. */
+    inline void complete(Return __pass__ bc) {
+      if (!kPath_) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int v = 0; v < kN_; v++) {
+        bc[v] += bc_[v];
+      }
+      bc_ = bc;
+      /* Finished sources were deposited unless the run was cancelled. */
+      if (!cancellation()) {
+        std::fill(done_.begin(), done_.end(), 1);
+      }
+      save();
+    }
+
+    /* File layout: magic, n, key, sizeof(Result), bitset of finished sources
+     * and accumulated results. */
+    inline void save() {
+      MICROPROF_START(checkpoint_save);
+      const std::string tmp_path = std::string(kPath_) + ".tmp";
+      FILE* fp = fopen(tmp_path.c_str(), "wb");
+      if (!fp) {
+        MICROPROF_WARN(true, "cannot write checkpoint");
+        return;
+      }
+      const int64_t n = kN_;
+      const uint32_t result_size = sizeof(Result);
+      std::vector<unsigned char> bits((kN_ + 7) / 8, 0);
+      int count = 0;
+      for (int s = 0; s < kN_; s++) {
+        if (done_[s]) {
+          bits[s / 8] |= 1 << (s % 8);
+          count++;
+        }
+      }
+      bool ok = fwrite(CHECKPOINT_MAGIC, 8, 1, fp) == 1 &&
+        fwrite(&n, sizeof(n), 1, fp) == 1 &&
+        fwrite(&kKey_, sizeof(kKey_), 1, fp) == 1 &&
+        fwrite(&result_size, sizeof(result_size), 1, fp) == 1 &&
+        fwrite(bits.data(), 1, bits.size(), fp) == bits.size() &&
+        fwrite(bc_.data(), sizeof(Result), kN_, fp) == static_cast<size_t>(n);
+      ok = (fclose(fp) == 0) && ok;
+      if (ok) {
+        ok = std::rename(tmp_path.c_str(), kPath_) == 0;
+      }
+      MICROPROF_WARN(!ok, "cannot write checkpoint");
+      MICROPROF_INFO("CHECKPOINT:\tsources saved\t%d / %d\n", count, kN_);
+      SUPPRESS_UNUSED(count);
+      MICROPROF_END(checkpoint_save);
+    }
+
+    inline bool resume() {
+      FILE* fp = fopen(kPath_, "rb");
+      if (!fp) {
+        return false;
+      }
+      MICROPROF_START(checkpoint_resume);
+      char magic[8];
+      int64_t n;
+      uint64_t key;
+      uint32_t result_size;
+      std::vector<unsigned char> bits((kN_ + 7) / 8, 0);
+      Return bc(kN_);
+      bool ok = fread(magic, 8, 1, fp) == 1 &&
+        std::memcmp(magic, CHECKPOINT_MAGIC, 8) == 0 &&
+        fread(&n, sizeof(n), 1, fp) == 1 && n == kN_ &&
+        fread(&key, sizeof(key), 1, fp) == 1 && key == kKey_ &&
+        fread(&result_size, sizeof(result_size), 1, fp) == 1 &&
+        result_size == sizeof(Result) &&
+        fread(bits.data(), 1, bits.size(), fp) == bits.size() &&
+        fread(bc.data(), sizeof(Result), kN_, fp) == static_cast<size_t>(n);
+      fclose(fp);
+      if (ok) {
+        skip_.assign(kN_, 0);
+        int count = 0;
+        for (int s = 0; s < kN_; s++) {
+          skip_[s] = done_[s] = (bits[s / 8] >> (s % 8)) & 1;
+          count += done_[s];
+        }
+        bc_.swap(bc);
+        MICROPROF_INFO("CHECKPOINT:\tsources resumed\t%d / %d\n", count, kN_);
+        SUPPRESS_UNUSED(count);
+      } else {
+        fprintf(stderr, "Checkpoint %s does not match the graph, ignoring.\n",
+            kPath_);
+      }
+      MICROPROF_END(checkpoint_resume);
+      return ok;
+    }
+  };
+
+  template<typename Return> const int SourceDispatch<Return>::kMaxWorkers;
+
+}  // namespace brandes
+
+#undef CHECKPOINT_MAGIC
+
+#endif  // BRANDESCHECKPOINT_H_
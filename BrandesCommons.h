@@ -2,11 +2,20 @@
 #ifndef BRANDESCOMMONS_H_
 #define BRANDESCOMMONS_H_
 
+#include <unistd.h>
+
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 #include <future>
+#include <atomic>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <algorithm>
 
-#include "./MicroBench.h"
+#include "./BrandesPool.h"
 #include "./MyCL.h"
 
 /* This is not very important since entire continuation gets inlined and
@@ -18,32 +27,263 @@
 namespace brandes {
   using mycl::Accelerator;
 
+  typedef int SigmaInt;
+
+  /** Traces batches of sources processed by one thread as spans, along
+   * with throughput counters. Edges is the number of edges traversed per
+   * source. */
+  class SourceBatchTrace {
+    private:
+      static const int kBatch = 64;
+      const int64_t kEdges_;
+      int count_;
+      int64_t start_;
+
+      static inline std::atomic<int64_t>& edges_traversed() {
+        static std::atomic<int64_t> total(0);
+        return total;
+      }
+
+      inline void flush() {
+        if (count_ > 0 && start_ >= 0) {
+          MicroTrace::end("source_batch", start_);
+          const int64_t elapsed = std::max<int64_t>(MicroTrace::now() - start_,
+              1);
+          MicroTrace::counter("sources per second", count_ * 1e9 / elapsed,
+              true);
+          MicroTrace::counter("edges traversed", edges_traversed() +=
+              count_ * kEdges_);
+        }
+        count_ = 0;
+        start_ = MicroTrace::begin();
+      }
+
+    public:
+      explicit SourceBatchTrace(int64_t edges) :
+        kEdges_(edges), count_(0), start_(MicroTrace::begin()) {}
+
+      ~SourceBatchTrace() {
+        flush();
+      }
+
+      inline void step() {
+#ifndef NO_TRACE
+        if (++count_ == kBatch) {
+          flush();
+        }
+#endif
+      }
+  };
+
+  /** Centralities computed along with betweenness on request. Vertex scores
+   * are indexed like scores returned by the stage which holds them, edge
+   * scores refer to edges_ (pairs with first < second). */
+  struct Metrics {
+    enum {
+      kCloseness = 1,
+      kHarmonic = 2,
+      kStress = 4,
+      kEdge = 8
+    };
+    unsigned requested_;
+    std::vector<double> closeness_;
+    std::vector<double> harmonic_;
+    std::vector<double> stress_;
+    std::vector<std::pair<int, int>> edges_;
+    std::vector<double> edge_bc_;
+
+    Metrics() : requested_(0) {}
+
+    /** Moves results to original numbering, bfsno maps original ids to the
+     * ones used during computation. */
+    template<typename VertexList>
+      inline void restore(const VertexList& bfsno) {
+        if (!requested_) {
+          return;
+        }
+        std::vector<int> orig(bfsno.size());
+        for (size_t v = 0; v < bfsno.size(); v++) {
+          orig[bfsno[v]] = v;
+        }
+        std::vector<double>* scores[3] = { &closeness_, &harmonic_, &stress_ };
+        for (auto score : scores) {
+          if (!score->empty()) {
+            std::vector<double> score1(score->size());
+            for (size_t v = 0; v < bfsno.size(); v++) {
+              score1[v] = (*score)[bfsno[v]];
+            }
+            score->swap(score1);
+          }
+        }
+        std::vector<std::pair<std::pair<int, int>, double>> edges;
+        for (size_t i = 0; i < edges_.size(); i++) {
+          int u = orig[edges_[i].first], v = orig[edges_[i].second];
+          edges.push_back(std::make_pair(std::make_pair(std::min(u, v),
+                  std::max(u, v)), edge_bc_[i]));
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); i++) {
+          edges_[i] = edges[i].first;
+          edge_bc_[i] = edges[i].second;
+        }
+      }
+  };
+
   struct Context {
-    std::future<Accelerator> dev_future_;
+    /* Shared, so that one device serves every run of the context. */
+    std::shared_future<Accelerator> dev_future_;
     const int kMDegLog2_;
     const int kWGroup_;
     const int kCPUJobs_;
     const bool kUseGPU_;
+    const float kDelta_;
+    const int kTeamMinN_;
+    /* CPU workers are pinned to NUMA nodes and read node-local replicas. */
+    bool numa_;
+    /* Bytes of per-worker state beyond which CPU workers share a source,
+     * 0 stands for half of MemAvailable from /proc/meminfo at the time of the
+     * run (which counts reclaimable page cache), or of physical memory if it
+     * cannot be read. */
+    int64_t state_budget_;
+    /* Stages free or reuse buffers of their predecessors, see release(). */
+    bool low_memory_;
+    /* Format of the input graph, picked by file extension unless set. */
+    const char* input_format_;
+    /* Checkpointing is disabled unless path is set. */
+    const char* checkpoint_path_;
+    double checkpoint_interval_;
+    /* Status file is not written unless path is set. */
+    const char* status_path_;
+    double status_interval_;
+    /* Sources are split among ranks, rank 0 listens on coordinator. */
+    int rank_;
+    int ranks_;
+    const char* coordinator_;
+    /* Sampled top-k mode, certified with confidence 1 - topk_delta_. */
+    int topk_;
+    double topk_delta_;
+    double topk_lambda_;
+    /* Restricted betweenness counts only paths from sources_ to targets_,
+     * empty list means all vertices. Masks are built by the ordering stage
+     * in the numbering seen by the engines. */
+    std::vector<int> sources_;
+    std::vector<int> targets_;
+    std::vector<char> sources_mask_;
+    std::vector<char> targets_mask_;
+    Metrics metrics_;
+    /* Threads are started on first use and serve every run of the context,
+     * they are pinned if numa_ is set by then. */
+    std::once_flag pool_once_;
+    std::unique_ptr<WorkerPool> pool_;
 
     Context(
         std::future<Accelerator> &&dev,
         int m_deg,
         int wgroup,
         int cpu_jobs,
-        bool use_gpu
+        bool use_gpu,
+        float delta,
+        int team_min_n
         ) :
-      dev_future_(std::move(dev)),
+      dev_future_(dev.share()),
       kMDegLog2_(std::ceil(std::log2(m_deg))),
       kWGroup_(wgroup),
-      kCPUJobs_(cpu_jobs),
-      kUseGPU_(use_gpu)
+      kCPUJobs_(cpu_jobs < 0 ? WorkerPool::hardware_jobs(use_gpu)
+          : cpu_jobs),
+      kUseGPU_(use_gpu),
+      kDelta_(delta),
+      kTeamMinN_(team_min_n),
+      numa_(false),
+      state_budget_(0),
+      low_memory_(false),
+      input_format_(nullptr),
+      checkpoint_path_(nullptr),
+      checkpoint_interval_(0),
+      status_path_(nullptr),
+      status_interval_(1),
+      rank_(0),
+      ranks_(1),
+      coordinator_(nullptr),
+      topk_(0),
+      topk_delta_(0.1),
+      topk_lambda_(0.001)
     {
       assert(1 << kMDegLog2_ == m_deg);
       assert(wgroup % MYCL_WGROUP_MULTIPLE == 0);
-      assert(cpu_jobs > 0 || use_gpu);
+      assert(kCPUJobs_ > 0 || use_gpu);
+      assert(delta >= 0);
     }
+
+    inline WorkerPool& pool() {
+      std::call_once(pool_once_, [this]() {
+          pool_.reset(new WorkerPool(std::max(kCPUJobs_, 1), numa_));
+          });
+      return *pool_;
+    }
+
+    inline int64_t state_budget() const {
+      if (state_budget_ > 0) {
+        return state_budget_;
+      }
+      long long kbytes = -1;
+      if (FILE* fp = fopen("/proc/meminfo", "r")) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp) &&
+            sscanf(line, "MemAvailable: %lld", &kbytes) != 1) {
+        }
+        fclose(fp);
+      }
+      if (kbytes < 0) {
+        return static_cast<int64_t>(sysconf(_SC_PHYS_PAGES)) *
+          sysconf(_SC_PAGESIZE) / 2;
+      }
+      return static_cast<int64_t>(kbytes) * 1024 / 2;
+    }
+
+    inline bool restricted() const {
+      return !sources_.empty() || !targets_.empty();
+    }
+
+    /** Contracted trees stand for all their vertices as sources and targets
+     * and only their contribution to betweenness is known. */
+    inline bool contractible() const {
+      return !restricted() && !metrics_.requested_;
+    }
+
+    /** Builds masks of restricted vertices for a graph of n vertices,
+     * relabel maps original ids to the current numbering. */
+    template<typename Relabel>
+      inline void restrict_masks(const int n, Relabel relabel) {
+        const std::vector<int>* lists[2] = { &sources_, &targets_ };
+        std::vector<char>* masks[2] = { &sources_mask_, &targets_mask_ };
+        for (int i = 0; i < 2; i++) {
+          masks[i]->clear();
+          if (!lists[i]->empty()) {
+            masks[i]->assign(n, 0);
+            for (int v : *lists[i]) {
+              MICROPROF_WARN(v < 0 || v >= n, "restricted vertex out of range");
+              if (0 <= v && v < n) {
+                (*masks[i])[relabel(v)] = 1;
+              }
+            }
+          }
+        }
+      }
   };
 
+  /** Frees a list once the stage it was handed to no longer needs it, if
+   * low-memory mode is on. Callers which keep their lists pass them as
+   * const, those are never freed. */
+  template<typename List>
+    inline void release(const Context __pass__ ctx, List __pass__ lst) {
+      if (ctx.low_memory_) {
+        List().swap(lst);
+      }
+    }
+
+  template<typename List>
+    inline void release(const Context __pass__, const List __pass__) {}
+
 }  // namespace brandes
 
 #endif  // BRANDESCOMMONS_H_
@@ -3,46 +3,64 @@
 #define BRANDESDEG1_H_
 
 #include <cassert>
+#include <cstdint>
 #include <vector>
+#include <algorithm>
 
 #include "./BrandesStats.h"
 
 namespace brandes {
 
+  template<typename Cont> struct deg1_pass;
+
   template<typename Cont> struct deg1_reduce {
-    template<typename Return, typename VertexList>
-      inline Return cont(
-          Context& ctx,
+    /** Contracts trees hanging off the graph, the functor is called with
+     * (new, old) positions of every surviving edge, new ones index a fresh
+     * list unless the graph is compacted in place. Peeling is sequential, so
+     * that contributions are summed in the same order whatever the number of
+     * threads, the rest runs on the pool. In-place compaction is sequential
+     * too, but needs no second copy of the graph. */
+    template<typename Return, typename VertexList, typename EdgeMove>
+      static inline void contract(
+          WorkerPool __pass__ pool,
+          const bool in_place,
           VertexList __pass__ ptr,
           VertexList __pass__ adj,
-          const VertexList __pass__ ccs
-          ) const {
+          const VertexList __pass__ ccs,
+          Return __pass__ bc,
+          Return __pass__ weight,
+          VertexList __pass__ newind,
+          EdgeMove move_edge
+          ) {
         typedef typename VertexList::value_type VertexId;
         typedef typename Return::value_type Result;
+        const int64_t kGrain = WorkerPool::kGrain;
         const VertexId n = ptr.size() - 1;
-        MICROPROF_START(deg1_reduction);
-        Return bc(n, 0.0f), weight(n, 1.0f);
+        bc.assign(n, 0.0f);
+        weight.assign(n, 1.0f);
+        newind.assign(n, 1);
         VertexList deg(n), ccsz(n);
-        VertexList queue(n), newind(n, 1);
+        VertexList queue(n);
         auto qfront = queue.begin(), qback = queue.begin();
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId i = lo; i < hi; i++) {
+              deg[i] = ptr[i + 1] - ptr[i];
+              assert(deg[i] >= 0);
+            }
+            });
         for (VertexId i = 0; i < n; i++) {
-          deg[i] = ptr[i + 1] - ptr[i];
-          assert(deg[i] >= 0);
           if (deg[i] <= 1) {
             *qback++ = i;
           }
         }
-        auto itccs = ccs.begin(),
-             itccsN = ccs.end() - 1;
-        while (itccs != itccsN) {
-          auto next = *itccs,
-               end = *++itccs,
-               size = end - next;
-          for (; next < end; next++) {
-            assert(next < ccsz.size());
-            ccsz[next] = size;
-          }
-        }
+        pool.parallel_for(0, ccs.size() - 1, 64, [&](int64_t lo, int64_t hi) {
+            for (int64_t cc = lo; cc < hi; cc++) {
+              const VertexId size = ccs[cc + 1] - ccs[cc];
+              assert(static_cast<size_t>(ccs[cc + 1]) <= ccsz.size());
+              std::fill(ccsz.begin() + ccs[cc], ccsz.begin() + ccs[cc + 1],
+                  size);
+            }
+            });
         while (qfront != qback) {
           VertexId u = *qfront++;
           assert(0 == deg[u] || deg[u] == 1);
@@ -66,51 +84,168 @@ namespace brandes {
             }
           }
         }
-        VertexId sum = 0;
-        for (auto& ind : newind) {
-          if (ind) {
-            ind = sum;
-            ++sum;
-          } else {
-            ind = -1;
-          }
-        }
-        VertexId icadj = 0, nind = 0;
-        for (VertexId oind = 0; oind < n; oind++) {
-          if (newind[oind] >= 0) {
-            assert(newind[oind] == nind);
-            auto next = adj.begin() + ptr[oind];
-            const auto last = adj.begin() + ptr[oind + 1];
-            assert(nind <= oind);
-            weight[nind] = weight[oind];
-            ptr[nind++] = icadj;
-            for (; next != last; next++) {
-              if (newind[*next] >= 0) {
-                assert(icadj <= next - adj.begin());
-                adj[icadj++] = newind[*next];
+        /* Survivors are numbered in order, deg keeps which ones survived. */
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            std::copy(newind.begin() + lo, newind.begin() + hi,
+                deg.begin() + lo);
+            });
+        const VertexId nind = pool.exclusive_scan(newind.begin(),
+            newind.end());
+        if (in_place) {
+          pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+              for (VertexId oind = lo; oind < hi; oind++) {
+                newind[oind] = deg[oind] ? newind[oind] : -1;
+              }
+              });
+          /* New positions never pass old ones. */
+          VertexId icadj = 0;
+          for (VertexId oind = 0; oind < n; oind++) {
+            const VertexId nv = newind[oind];
+            if (nv < 0) {
+              continue;
+            }
+            const VertexId first = ptr[oind], last = ptr[oind + 1];
+            assert(nv <= oind);
+            weight[nv] = weight[oind];
+            ptr[nv] = icadj;
+            for (VertexId i = first; i < last; i++) {
+              if (newind[adj[i]] >= 0) {
+                assert(icadj <= i);
+                move_edge(icadj, i);
+                adj[icadj++] = newind[adj[i]];
               }
             }
           }
+          ptr[nind] = icadj;
+          ptr.resize(nind + 1);
+          weight.resize(nind);
+          adj.resize(icadj);
+          return;
         }
-        ptr[nind++] = icadj;
-        ptr.resize(nind);
-        weight.resize(nind - 1);
-        adj.resize(icadj);
-        assert(ptr.back() == adj.size());
+        VertexList nptr(nind + 1);
+        Return nweight(nind);
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId oind = lo; oind < hi; oind++) {
+              if (!deg[oind]) {
+                newind[oind] = -1;
+                continue;
+              }
+              VertexId count = 0;
+              for (VertexId i = ptr[oind]; i < ptr[oind + 1]; i++) {
+                count += deg[adj[i]];
+              }
+              nptr[newind[oind]] = count;
+              nweight[newind[oind]] = weight[oind];
+            }
+            });
+        nptr[nind] = 0;
+        const VertexId icadj = pool.exclusive_scan(nptr.begin(), nptr.end());
+        VertexList nadj(icadj);
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId oind = lo; oind < hi; oind++) {
+              if (newind[oind] < 0) {
+                continue;
+              }
+              VertexId pos = nptr[newind[oind]];
+              for (VertexId i = ptr[oind]; i < ptr[oind + 1]; i++) {
+                if (newind[adj[i]] >= 0) {
+                  move_edge(pos, i);
+                  nadj[pos++] = newind[adj[i]];
+                }
+              }
+              assert(pos == nptr[newind[oind] + 1]);
+            }
+            });
+        ptr.swap(nptr);
+        adj.swap(nadj);
+        weight.swap(nweight);
+        assert(static_cast<size_t>(ptr.back()) == adj.size());
         assert(ptr.size() > 0);
         assert(ptr.size() > 1 || ptr.back() == 0);
         assert(weight.size() == ptr.size() - 1);
+      }
+
+    template<typename Return, typename VertexList>
+      static inline void expand(
+          WorkerPool __pass__ pool,
+          Return __pass__ bc,
+          const Return __pass__ bc1,
+          const VertexList __pass__ newind
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        MICROPROF_START(deg1_expansion);
+        pool.parallel_for(0, newind.size(), WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId oind = lo; oind < hi; oind++) {
+              if (newind[oind] != -1) {
+                bc[oind] += bc1[newind[oind]];
+              }
+            }
+            });
+        MICROPROF_END(deg1_expansion);
+      }
+
+    template<typename Return, typename VertexList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          const VertexList __pass__ ccs
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        if (!ctx.contractible()) {
+          return deg1_pass<Cont>().template cont<Return>(ctx, ptr, adj, ccs);
+        }
+        MICROPROF_START(deg1_reduction);
+        MICROMEM_BEGIN(deg1_reduction);
+        Return bc, weight;
+        VertexList newind;
+        contract(ctx.pool(), ctx.low_memory_, ptr, adj, ccs, bc, weight,
+            newind, [](VertexId, VertexId) {});
+        MICROMEM_END(deg1_reduction);
         MICROPROF_END(deg1_reduction);
         if (adj.size() > 0) {
           /* We don't fix ccs because we don't use it anymore. */
           auto bc1 = CONT_BIND(ctx, ptr, adj, weight);
-          MICROPROF_START(deg1_expansion);
-          for (VertexId oind = 0; oind < n; oind++) {
-            if (newind[oind] != -1) {
-              bc[oind] += bc1[newind[oind]];
-            }
-          }
-          MICROPROF_END(deg1_expansion);
+          expand(ctx.pool(), bc, bc1, newind);
+        } else {
+          fprintf(stderr, "0\n0\n");
+        }
+        return bc;
+      }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len,
+          const VertexList __pass__ ccs
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        if (!ctx.contractible()) {
+          return deg1_pass<Cont>().template cont<Return>(ctx, ptr, adj, len,
+              ccs);
+        }
+        MICROPROF_START(deg1_reduction);
+        MICROMEM_BEGIN(deg1_reduction);
+        Return bc, weight;
+        VertexList newind;
+        /* Lengths move within their list when the graph does. */
+        const bool in_place = ctx.low_memory_;
+        LengthList clen(in_place ? 0 : len.size());
+        LengthList& olen = in_place ? len : clen;
+        contract(ctx.pool(), in_place, ptr, adj, ccs, bc, weight, newind,
+            [&](VertexId to, VertexId from) { olen[to] = len[from]; });
+        olen.resize(adj.size());
+        if (!in_place) {
+          len.swap(clen);
+        }
+        MICROMEM_END(deg1_reduction);
+        MICROPROF_END(deg1_reduction);
+        if (adj.size() > 0) {
+          auto bc1 = CONT_BIND(ctx, ptr, adj, len, weight);
+          expand(ctx.pool(), bc, bc1, newind);
         } else {
           fprintf(stderr, "0\n0\n");
         }
@@ -132,6 +267,20 @@ namespace brandes {
         Return weight(n, 1.0f);
         return CONT_BIND(ctx, ptr, adj, weight);
       }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len,
+          const VertexList __pass__
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        Return weight(n, 1.0f);
+        return CONT_BIND(ctx, ptr, adj, len, weight);
+      }
   };
 
 }  // namespace brandes
@@ -0,0 +1,208 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESDAEMON_H_
+#define BRANDESDAEMON_H_
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+
+#include "./BrandesEngine.h"
+
+namespace brandes {
+
+  /** Answers requests over a local socket while keeping the graph and its
+   * betweenness in memory. Requests are single lines:
+   *   FULL                   scores of all vertices
+   *   VERTICES v1 v2 ...     scores of given vertices
+   *   SAMPLE k [seed]        estimate from k random sources
+   *   UPDATE                 followed by "+ u v" / "- u v" lines and an empty
+   *                          line, applies changes to the resident graph
+   *   SHUTDOWN               stops the daemon
+   * Every response starts with "OK count" followed by count lines, or with
+   * "ERROR message". The preprocessed graph of the initial run is not kept,
+   * edge changes would invalidate its order and contraction; queries use the
+   * resident scores and the plain CSR of the incremental engine instead. */
+  template<typename Accumulator = std::vector<double>>
+    class bc_daemon {
+      private:
+        typedef typename incremental_bc<Accumulator>::VertexId VertexId;
+        typedef typename incremental_bc<Accumulator>::VertexList VertexList;
+
+        Context& ctx_;
+        incremental_bc<Accumulator>& engine_;
+
+        inline void full(FILE* out) {
+          fprintf(out, "OK %d\n", engine_.size());
+          for (auto score : engine_.bc_) {
+            fprintf(out, "%f\n", static_cast<double>(score));
+          }
+        }
+
+        inline void vertices(FILE* out, const char* args) {
+          std::vector<VertexId> ids;
+          int v, used;
+          while (sscanf(args, " %d%n", &v, &used) == 1) {
+            if (v < 0 || v >= engine_.size()) {
+              fprintf(out, "ERROR vertex %d out of range\n", v);
+              return;
+            }
+            ids.push_back(v);
+            args += used;
+          }
+          fprintf(out, "OK %zu\n", ids.size());
+          for (auto id : ids) {
+            fprintf(out, "%d %f\n", id, static_cast<double>(engine_.bc_[id]));
+          }
+        }
+
+        /* Brandes estimator, sampled dependencies are scaled by n / k. */
+        inline void sample(FILE* out, const char* args) {
+          const VertexId n = engine_.size();
+          int k = 0;
+          unsigned seed = std::random_device()();
+          if (sscanf(args, " %d %u", &k, &seed) < 1 || k <= 0) {
+            fprintf(out, "ERROR expected SAMPLE k [seed]\n");
+            return;
+          }
+          k = std::min(k, n);
+          VertexList sources(n);
+          for (VertexId s = 0; s < n; s++) {
+            sources[s] = s;
+          }
+          std::mt19937 gen(seed);
+          for (int i = 0; i < k; i++) {
+            std::uniform_int_distribution<VertexId> pick(i, n - 1);
+            std::swap(sources[i], sources[pick(gen)]);
+          }
+          sources.resize(k);
+          std::sort(sources.begin(), sources.end());
+          /* Resident scores are set aside while the engine accumulates. */
+          Accumulator estimate(n, 0.0);
+          engine_.bc_.swap(estimate);
+          engine_.add_contributions(ctx_, sources,
+              static_cast<double>(n) / k);
+          engine_.bc_.swap(estimate);
+          fprintf(out, "OK %d\n", n);
+          for (auto score : estimate) {
+            fprintf(out, "%f\n", static_cast<double>(score));
+          }
+        }
+
+        inline void update(FILE* in, FILE* out) {
+          std::vector<EdgeUpdate> batch;
+          char line[256];
+          while (fgets(line, sizeof(line), in)) {
+            char op;
+            EdgeUpdate upd;
+            if (sscanf(line, " %c %d %d", &op, &upd.edge_.v1_,
+                  &upd.edge_.v2_) == 3 && (op == '+' || op == '-') &&
+                upd.edge_.v1_ >= 0 && upd.edge_.v2_ >= 0) {
+              upd.insert_ = (op == '+');
+              batch.push_back(upd);
+            } else {
+              break;
+            }
+          }
+          const VertexId recomputed = engine_.update(ctx_, batch);
+          fprintf(out, "OK 1\n%d\n", recomputed);
+        }
+
+      public:
+        bc_daemon(Context& ctx, incremental_bc<Accumulator>& engine) :
+          ctx_(ctx), engine_(engine) {}
+
+        /** Serves one connection, returns false on shutdown request. */
+        inline bool session(int fd) {
+          FILE* in = fdopen(dup(fd), "r");
+          FILE* out = fdopen(fd, "w");
+          assert(in && out);
+          bool running = true;
+          char line[1 << 16];
+          while (running && fgets(line, sizeof(line), in)) {
+            char cmd[16] = "";
+            int used = 0;
+            sscanf(line, " %15s%n", cmd, &used);
+            MICROPROF_START(daemon_request);
+            if (std::strcmp(cmd, "FULL") == 0) {
+              full(out);
+            } else if (std::strcmp(cmd, "VERTICES") == 0) {
+              vertices(out, line + used);
+            } else if (std::strcmp(cmd, "SAMPLE") == 0) {
+              sample(out, line + used);
+            } else if (std::strcmp(cmd, "UPDATE") == 0) {
+              update(in, out);
+            } else if (std::strcmp(cmd, "SHUTDOWN") == 0) {
+              fprintf(out, "OK 0\n");
+              running = false;
+            } else if (cmd[0]) {
+              fprintf(out, "ERROR unknown request %s\n", cmd);
+            }
+            fflush(out);
+            MICROPROF_END(daemon_request);
+          }
+          fclose(in);
+          fclose(out);
+          return running;
+        }
+
+        inline void serve(const char* socket_path) {
+          /* Clients which disconnect early must not kill the daemon. */
+          signal(SIGPIPE, SIG_IGN);
+          sockaddr_un addr = sockaddr_un();
+          addr.sun_family = AF_UNIX;
+          assert(strlen(socket_path) < sizeof(addr.sun_path));
+          strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+          int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+          unlink(socket_path);
+          if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(
+                  &addr), sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+            fprintf(stderr, "Cannot listen on %s.\n", socket_path);
+            return;
+          }
+          MICROPROF_INFO("DAEMON:\tlistening on\t%s\n", socket_path);
+          for (bool running = true; running;) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0) {
+              running = session(fd);
+            }
+          }
+          close(listen_fd);
+          unlink(socket_path);
+        }
+    };
+
+  /** Computes betweenness of the graph with the full pipeline once, then
+   * serves requests until shutdown, returns scores of the final graph. */
+  template<typename Pipe, typename Return = std::vector<float>>
+    inline Return daemon_read(
+        Context& ctx,
+        const char* file_path,
+        const char* socket_path
+        ) {
+      auto E = generic_read<edges_store, std::vector<Edge>>(ctx, file_path);
+      Edge::VertexId n = 0;
+      for (auto& e : E) {
+        n = std::max(n, std::max(e.v1_, e.v2_) + 1);
+      }
+      /* Edges are kept for updates. */
+      const std::vector<Edge>& edges = E;
+      Return bc = E.empty() ? EmptyGraph<Return>::result(n)
+        : Pipe().template cont<Return>(ctx, n, edges);
+      incremental_bc<> engine(ctx, E, bc);
+      bc_daemon<> daemon(ctx, engine);
+      daemon.serve(socket_path);
+      return Return(engine.bc_.begin(), engine.bc_.end());
+    }
+
+}  // namespace brandes
+
+#endif  // BRANDESDAEMON_H_
@@ -0,0 +1,235 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESDISTRIBUTED_H_
+#define BRANDESDISTRIBUTED_H_
+
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "./BrandesCheckpoint.h"
+
+#ifndef DISTRIBUTED_CONNECT_SECS
+#define DISTRIBUTED_CONNECT_SECS 3600
+#endif
+
+namespace brandes {
+
+  /** Sums partial results of all processes sharing a run, each process ends
+   * up with the total. Rank 0 listens on the coordinator address, the other
+   * ranks connect to it once they are done. */
+  class ReduceGroup {
+    private:
+      const int kRank_;
+      const int kRanks_;
+      int listen_fd_;
+
+      static void fail(const char* what) {
+        fprintf(stderr, "Distributed run failed: %s\n", what);
+        std::exit(EXIT_FAILURE);
+      }
+
+      static void send_all(int fd, const void* buf, size_t size) {
+        const char* data = static_cast<const char*>(buf);
+        while (size > 0) {
+          ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+          if (sent <= 0) {
+            fail("send");
+          }
+          data += sent;
+          size -= sent;
+        }
+      }
+
+      static void recv_all(int fd, void* buf, size_t size) {
+        char* data = static_cast<char*>(buf);
+        while (size > 0) {
+          ssize_t got = recv(fd, data, size, 0);
+          if (got <= 0) {
+            fail("receive");
+          }
+          data += got;
+          size -= got;
+        }
+      }
+
+      static addrinfo* resolve(const char* coordinator, bool passive) {
+        const std::string address(coordinator);
+        const size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+          fail("coordinator must be given as host:port");
+        }
+        const std::string host = address.substr(0, colon),
+              port = address.substr(colon + 1);
+        addrinfo hints = addrinfo();
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+              &hints, &res) != 0) {
+          fail("cannot resolve coordinator");
+        }
+        return res;
+      }
+
+      /* Peers may finish before the coordinator reaches this stage. */
+      static int connect_retry(const char* coordinator) {
+        addrinfo* res = resolve(coordinator, false);
+        for (int attempt = 0; attempt < DISTRIBUTED_CONNECT_SECS * 10;
+            attempt++) {
+          for (addrinfo* ai = res; ai; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+              freeaddrinfo(res);
+              return fd;
+            }
+            if (fd >= 0) {
+              close(fd);
+            }
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        freeaddrinfo(res);
+        fail("cannot connect to coordinator");
+        return -1;
+      }
+
+      /* Waits for the next peer as long as peers wait for the coordinator,
+       * returns -1 if the run was cancelled meanwhile. */
+      int accept_wait() const {
+        for (int attempt = 0; attempt < DISTRIBUTED_CONNECT_SECS * 10;
+            attempt++) {
+          if (cancellation()) {
+            return -1;
+          }
+          pollfd pfd = pollfd();
+          pfd.fd = listen_fd_;
+          pfd.events = POLLIN;
+          if (poll(&pfd, 1, 100) > 0) {
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+              fail("accept");
+            }
+            return fd;
+          }
+        }
+        fail("timed out waiting for peers");
+        return -1;
+      }
+
+    public:
+      explicit ReduceGroup(Context& ctx) :
+        kRank_(ctx.rank_), kRanks_(ctx.ranks_), listen_fd_(-1)
+      {
+        assert(0 <= kRank_ && kRank_ < kRanks_);
+        if (kRanks_ > 1 && kRank_ == 0) {
+          /* Bind early so that peers which finish first queue up. */
+          addrinfo* res = resolve(ctx.coordinator_, true);
+          for (addrinfo* ai = res; ai && listen_fd_ < 0; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            int yes = 1;
+            if (fd >= 0 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes,
+                  sizeof(yes)) == 0 && bind(fd, ai->ai_addr, ai->ai_addrlen)
+                == 0 && listen(fd, kRanks_) == 0) {
+              listen_fd_ = fd;
+            } else if (fd >= 0) {
+              close(fd);
+            }
+          }
+          freeaddrinfo(res);
+          if (listen_fd_ < 0) {
+            fail("cannot listen on coordinator address");
+          }
+        }
+      }
+
+      ~ReduceGroup() {
+        if (listen_fd_ >= 0) {
+          close(listen_fd_);
+        }
+      }
+
+      ReduceGroup(const ReduceGroup&) = delete;
+      ReduceGroup& operator=(const ReduceGroup&) = delete;
+
+      /* Message: rank, n, graph key, followed by n results. If the run is
+       * cancelled while rank 0 waits for peers, its results stay partial. */
+      template<typename Return>
+        void allreduce(
+            Context& ctx,
+            Return __pass__ bc,
+            const uint64_t key
+            ) {
+          typedef typename Return::value_type Result;
+          if (kRanks_ == 1) {
+            return;
+          }
+          MICROPROF_START(distributed_reduce);
+          const int64_t n = bc.size();
+          if (kRank_ == 0) {
+            std::vector<int> peers;
+            std::vector<char> received(kRanks_, 0);
+            Return bc1(n);
+            for (int i = 1; i < kRanks_; i++) {
+              int fd = accept_wait();
+              if (fd < 0) {
+                for (int peer : peers) {
+                  close(peer);
+                }
+                fprintf(stderr, "Cancelled while waiting for peers, results "
+                    "of rank 0 only.\n");
+                MICROPROF_END(distributed_reduce);
+                return;
+              }
+              int32_t rank;
+              int64_t n1;
+              uint64_t key1;
+              recv_all(fd, &rank, sizeof(rank));
+              if (rank <= 0 || rank >= kRanks_ || received[rank]) {
+                fail("peer sent invalid or duplicate rank");
+              }
+              received[rank] = 1;
+              recv_all(fd, &n1, sizeof(n1));
+              recv_all(fd, &key1, sizeof(key1));
+              if (n1 != n || key1 != key) {
+                fail("peer computed different graph");
+              }
+              recv_all(fd, bc1.data(), n * sizeof(Result));
+              for (int64_t v = 0; v < n; v++) {
+                bc[v] += bc1[v];
+              }
+              MICROPROF_INFO("DISTRIBUTED:\treceived rank\t%d\n", rank);
+              peers.push_back(fd);
+            }
+            for (int fd : peers) {
+              send_all(fd, bc.data(), n * sizeof(Result));
+              close(fd);
+            }
+          } else {
+            int fd = connect_retry(ctx.coordinator_);
+            const int32_t rank = kRank_;
+            send_all(fd, &rank, sizeof(rank));
+            send_all(fd, &n, sizeof(n));
+            send_all(fd, &key, sizeof(key));
+            send_all(fd, bc.data(), n * sizeof(Result));
+            recv_all(fd, bc.data(), n * sizeof(Result));
+            close(fd);
+          }
+          MICROPROF_END(distributed_reduce);
+        }
+  };
+
+}  // namespace brandes
+
+#endif  // BRANDESDISTRIBUTED_H_
@@ -0,0 +1,151 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESENGINE_H_
+#define BRANDESENGINE_H_
+
+#include <cassert>
+#include <vector>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+#include "./BrandesIncremental.h"
+
+namespace brandes {
+
+  /** Betweenness for embedding applications. The device, its compiled
+   * program and the runner thread are created once and reused by every
+   * request, requests are served one at a time in submission order. Tail is
+   * the pipeline which follows CSR construction, e.g.
+   * ocsr_create<no_stats<deg1_reduce<cpu_driver<vcsr_create<betweenness>>>>>.
+   */
+  template<typename Tail, typename Return = std::vector<float>>
+    class Engine {
+      public:
+        typedef Return Scores;
+
+        Engine(
+            int m_deg,
+            int wgroup,
+            int cpu_jobs,
+            bool use_gpu,
+            float delta = 0,
+            int team_min_n = 1 << 20
+            ) :
+          ctx_(use_gpu
+              ? std::async(std::launch::async, mycl::init_device)
+              : std::async(std::launch::deferred, mycl::init_device),
+              m_deg, wgroup, cpu_jobs, use_gpu, delta, team_min_n),
+          stop_(false),
+          runner_(&Engine::run, this)
+        {}
+
+        ~Engine() {
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+          }
+          cond_.notify_one();
+          runner_.join();
+        }
+
+        Engine(const Engine&) = delete;
+        Engine& operator=(const Engine&) = delete;
+
+        /** Optional settings (checkpoints etc.) must be adjusted before the
+         * first request. */
+        inline Context& context() {
+          return ctx_;
+        }
+
+        /** Edge list of n vertices, each undirected edge listed once. */
+        template<typename EdgeType>
+          inline std::future<Return> submit(
+              const typename EdgeType::VertexId n,
+              std::vector<EdgeType> E
+              ) {
+            assert(!E.empty());
+            return enqueue([this, n, E] () mutable -> Return {
+                return csr_stage(E)
+                  .template cont<Return>(ctx_, n, E);
+            });
+          }
+
+        /** Symmetric CSR, every undirected edge is stored in both
+         * directions. */
+        template<typename VertexList>
+          inline std::future<Return> submit_csr(
+              VertexList ptr,
+              VertexList adj
+              ) {
+            assert(!ptr.empty() && ptr.back() == adj.size());
+            return enqueue([this, ptr, adj] () mutable -> Return {
+                return Tail().template cont<Return>(ctx_, ptr, adj);
+            });
+          }
+
+        /** Symmetric CSR with edge lengths, requires weighted pipeline. */
+        template<typename VertexList, typename LengthList>
+          inline std::future<Return> submit_csr(
+              VertexList ptr,
+              VertexList adj,
+              LengthList len
+              ) {
+            assert(!ptr.empty() && ptr.back() == adj.size());
+            assert(len.size() == adj.size());
+            return enqueue([this, ptr, adj, len] () mutable -> Return {
+                return Tail().template cont<Return>(ctx_, ptr, adj, len);
+            });
+          }
+
+      private:
+        Context ctx_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<std::packaged_task<Return()>> tasks_;
+        bool stop_;
+        std::thread runner_;
+
+        static inline csr_create<Tail> csr_stage(const std::vector<Edge>&) {
+          return csr_create<Tail>();
+        }
+
+        static inline wcsr_create<Tail> csr_stage(
+            const std::vector<WeightedEdge>&) {
+          return wcsr_create<Tail>();
+        }
+
+        template<typename Task>
+          inline std::future<Return> enqueue(Task task) {
+            std::packaged_task<Return()> job(task);
+            std::future<Return> result = job.get_future();
+            {
+              std::lock_guard<std::mutex> lock(mutex_);
+              tasks_.push_back(std::move(job));
+            }
+            cond_.notify_one();
+            return result;
+          }
+
+        void run() {
+          for (;;) {
+            std::packaged_task<Return()> job;
+            {
+              std::unique_lock<std::mutex> lock(mutex_);
+              cond_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+              if (tasks_.empty()) {
+                return;
+              }
+              job = std::move(tasks_.front());
+              tasks_.pop_front();
+            }
+            job();
+          }
+        }
+    };
+
+}  // namespace brandes
+
+#endif  // BRANDESENGINE_H_
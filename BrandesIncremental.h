@@ -0,0 +1,385 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESINCREMENTAL_H_
+#define BRANDESINCREMENTAL_H_
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <utility>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <functional>
+
+#include "./BrandesBetweenness.h"
+
+namespace brandes {
+
+  struct EdgeUpdate {
+    Edge edge_;
+    bool insert_;
+  };
+
+  /** Terminal continuation which hands the edge list back to the caller. */
+  struct edges_store {
+    template<typename Return, typename VertexId, typename EdgeList>
+      inline Return cont(
+          Context&,
+          const VertexId,
+          const EdgeList __pass__ E
+          ) const {
+        return E;
+      }
+  };
+
+  /** Terminal continuation which hands the adjacency back to the caller. */
+  struct csr_store {
+    template<typename Return, typename VertexList>
+      inline Return cont(
+          Context&,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj
+          ) const {
+        return Return(ptr, adj);
+      }
+  };
+
+  /** Reads "+ u v" and "- u v" lines, empty line closes a batch. */
+  inline std::vector<std::vector<EdgeUpdate>> read_updates(
+      const char* file_path) {
+    std::vector<std::vector<EdgeUpdate>> batches(1);
+    std::ifstream in(file_path);
+    if (!in.good()) {
+      fprintf(stderr, "Cannot read %s\n", file_path);
+      std::exit(EXIT_FAILURE);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+      char op;
+      EdgeUpdate upd;
+      if (sscanf(line.c_str(), " %c %d %d", &op, &upd.edge_.v1_,
+            &upd.edge_.v2_) == 3 && (op == '+' || op == '-')) {
+        if (upd.edge_.v1_ < 0 || upd.edge_.v2_ < 0) {
+          fprintf(stderr, "Cannot read %s: negative vertex id in \"%s\"\n",
+              file_path, line.c_str());
+          std::exit(EXIT_FAILURE);
+        }
+        upd.insert_ = (op == '+');
+        batches.back().push_back(upd);
+      } else if (line.find_first_not_of(" \t\r") == std::string::npos &&
+          !batches.back().empty()) {
+        batches.push_back(std::vector<EdgeUpdate>());
+      }
+    }
+    if (batches.back().empty()) {
+      batches.pop_back();
+    }
+    return batches;
+  }
+
+  template<typename VertexList>
+    static inline void bfs_levels(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const typename VertexList::value_type root,
+        VertexList __pass__ dist,
+        VertexList __pass__ queue
+        ) {
+      std::fill(dist.begin(), dist.end(), -1);
+      auto qfront = queue.begin(), qback = qfront;
+      dist[root] = 0;
+      *qback++ = root;
+      while (qfront != qback) {
+        auto v = *qfront++;
+        for (auto i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+          auto w = adj[i];
+          if (dist[w] < 0) {
+            dist[w] = dist[v] + 1;
+            *qback++ = w;
+          }
+        }
+      }
+    }
+
+  /** Marks sources whose shortest-path DAG is altered by given changes,
+   * relies on d(s, u) = d(u, s) in undirected graphs, so that two BFS runs per
+   * changed edge replace per-source distance tables. */
+  template<typename VertexList>
+    static inline std::vector<char> affected_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const std::vector<EdgeUpdate> __pass__ changes,
+        std::atomic_int* change_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      const VertexId n = ptr.size() - 1;
+      std::vector<char> affected(n, 0);
+      VertexList du(n), dv(n), queue(n);
+      VertexId last_u = -1, ci;
+      while ((ci = (*change_dispatch)++) < static_cast<int>(changes.size())) {
+        const EdgeUpdate& upd = changes[ci];
+        const VertexId u = upd.edge_.v1_, v = upd.edge_.v2_;
+        if (u == v) {
+          continue;
+        }
+        /* Changes are sorted, consecutive ones often share an endpoint. */
+        if (u != last_u) {
+          bfs_levels(ptr, adj, u, du, queue);
+          last_u = u;
+        }
+        bfs_levels(ptr, adj, v, dv, queue);
+        for (VertexId s = 0; s < n; s++) {
+          if (upd.insert_) {
+            affected[s] |= du[s] != dv[s];
+          } else {
+            affected[s] |= du[s] >= 0 && (du[s] - dv[s] == 1 ||
+                dv[s] - du[s] == 1);
+          }
+        }
+      }
+      return affected;
+    }
+
+  template<typename Accumulator, typename VertexList>
+    static inline Accumulator recompute_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const VertexList __pass__ sources,
+        const typename Accumulator::value_type scale,
+        std::atomic_int* source_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef std::vector<float> Return;
+      const VertexId n = ptr.size() - 1;
+      const Return weight(n, 1.0f);
+      Accumulator bc(n, 0.0);
+      CPUSourceState<Return, VertexList> state(n);
+      VertexId si;
+      while ((si = (*source_dispatch)++) < static_cast<int>(sources.size())) {
+        bc_cpu_source(ptr, adj, weight, sources[si], 0, n, scale, state, bc);
+      }
+      return bc;
+    }
+
+  /** Maintains betweenness of a changing graph, only sources which see
+   * a different shortest-path DAG after a batch are recomputed. */
+  template<typename Accumulator = std::vector<double>>
+    struct incremental_bc {
+      typedef Edge::VertexId VertexId;
+      typedef RawVector<VertexId> VertexList;
+      typedef std::pair<VertexList, VertexList> Adjacency;
+
+      /* Edges have v1_ <= v2_ and are kept sorted. */
+      std::vector<Edge> E_;
+      Adjacency csr_;
+      Accumulator bc_;
+
+      template<typename EdgeList, typename Scores>
+        incremental_bc(
+            Context& ctx,
+            const EdgeList __pass__ E,
+            const Scores __pass__ bc
+            ) :
+          E_(E),
+          bc_(bc.begin(), bc.end())
+      {
+        for (auto& e : E_) {
+          if (e.v1_ > e.v2_) {
+            std::swap(e.v1_, e.v2_);
+          }
+        }
+        std::sort(E_.begin(), E_.end(), edge_less);
+        csr_ = build(ctx, bc_.size());
+      }
+
+      static inline bool edge_less(const Edge& a, const Edge& b) {
+        return a.v1_ < b.v1_ || (a.v1_ == b.v1_ && a.v2_ < b.v2_);
+      }
+
+      static inline bool edge_equal(const Edge& a, const Edge& b) {
+        return a.v1_ == b.v1_ && a.v2_ == b.v2_;
+      }
+
+      inline Adjacency build(Context& ctx, const VertexId n) const {
+        return csr_create<csr_store>().template cont<Adjacency>(ctx, n, E_);
+      }
+
+      inline VertexId size() const {
+        return bc_.size();
+      }
+
+      inline void add_contributions(
+          Context& ctx,
+          const VertexList __pass__ sources,
+          const typename Accumulator::value_type scale
+          ) {
+        std::atomic_int source_dispatch(0);
+        std::vector<std::future<Accumulator>> jobs;
+        for (int i = 0, iN = std::max(ctx.kCPUJobs_, 1); i < iN; i++) {
+          jobs.push_back(ctx.pool().submit([&]() {
+                return recompute_worker<Accumulator, VertexList>(csr_.first,
+                  csr_.second, sources, scale, &source_dispatch);
+                }));
+        }
+        for (auto& job : jobs) {
+          auto bc1 = job.get();
+          for (VertexId v = 0, n = size(); v < n; v++) {
+            bc_[v] += bc1[v];
+          }
+        }
+      }
+
+      /** Applies one batch of changes, returns number of recomputed
+       * sources. */
+      inline VertexId update(
+          Context& ctx,
+          const std::vector<EdgeUpdate> __pass__ batch
+          ) {
+        MICROPROF_START(incremental_update);
+        /* Net change per vertex pair, insertions of new vertices grow the
+         * graph with isolated vertices first. */
+        std::vector<std::pair<Edge, int>> net;
+        VertexId n = size();
+        for (const EdgeUpdate& upd : batch) {
+          Edge e = upd.edge_;
+          assert(e.v1_ >= 0 && e.v2_ >= 0);
+          if (e.v1_ > e.v2_) {
+            std::swap(e.v1_, e.v2_);
+          }
+          if (upd.insert_) {
+            n = std::max(n, e.v2_ + 1);
+          }
+          net.push_back(std::make_pair(e, upd.insert_ ? 1 : -1));
+        }
+        std::sort(net.begin(), net.end(), [](const std::pair<Edge, int>& a,
+              const std::pair<Edge, int>& b) {
+            return edge_less(a.first, b.first);
+        });
+        if (n > size()) {
+          bc_.resize(n, 0.0);
+          csr_.first.resize(n + 1, csr_.first.back());
+        }
+        /* Merge changes into the sorted edge list. */
+        std::vector<Edge> E1;
+        std::vector<EdgeUpdate> changes;
+        E1.reserve(E_.size() + net.size());
+        auto ite = E_.begin();
+        const auto iteN = E_.end();
+        for (auto itn = net.begin(); itn != net.end();) {
+          const Edge e = itn->first;
+          int delta = 0;
+          for (; itn != net.end() && edge_equal(itn->first, e); itn++) {
+            delta += itn->second;
+          }
+          for (; ite != iteN && edge_less(*ite, e); ite++) {
+            E1.push_back(*ite);
+          }
+          int count = 0;
+          for (; ite != iteN && edge_equal(*ite, e); ite++) {
+            count++;
+          }
+          MICROPROF_WARN(count + delta < 0, "deleting missing edge");
+          const int count1 = std::max(count + delta, 0);
+          E1.insert(E1.end(), count1, e);
+          /* Adjacency drops self-loops and repeated edges. */
+          if ((count1 > 0) != (count > 0) && e.v1_ != e.v2_) {
+            EdgeUpdate upd = { e, count1 > count };
+            changes.push_back(upd);
+          }
+        }
+        E1.insert(E1.end(), ite, iteN);
+        /* Find sources to recompute on the old graph. */
+        std::vector<char> affected(n, 0);
+        {
+          std::atomic_int change_dispatch(0);
+          std::vector<std::future<std::vector<char>>> jobs;
+          for (int i = 0, iN = std::max(ctx.kCPUJobs_, 1); i < iN; i++) {
+            jobs.push_back(ctx.pool().submit([&]() {
+                  return affected_worker<VertexList>(csr_.first, csr_.second,
+                    changes, &change_dispatch);
+                  }));
+          }
+          for (auto& job : jobs) {
+            auto aff1 = job.get();
+            for (VertexId s = 0; s < n; s++) {
+              affected[s] |= aff1[s];
+            }
+          }
+        }
+        VertexList sources;
+        for (VertexId s = 0; s < n; s++) {
+          if (affected[s]) {
+            sources.push_back(s);
+          }
+        }
+        /* Swap contributions of affected sources. */
+        if (!sources.empty()) {
+          add_contributions(ctx, sources, -1.0);
+          E_.swap(E1);
+          csr_ = build(ctx, n);
+          add_contributions(ctx, sources, 1.0);
+        } else {
+          E_.swap(E1);
+          csr_ = build(ctx, n);
+        }
+        MICROPROF_INFO("INCREMENTAL:\tchanged pairs\t%zu\n", changes.size());
+        MICROPROF_INFO("INCREMENTAL:\tsources recomputed\t%zu / %d\n",
+            sources.size(), n);
+        MICROPROF_END(incremental_update);
+        return sources.size();
+      }
+    };
+
+  /** Computes betweenness of the base graph (or loads it from base_path),
+   * then applies all batches from updates_path. */
+  template<typename Pipe, typename Return = std::vector<float>>
+    inline Return incremental_read(
+        Context& ctx,
+        const char* file_path,
+        const char* base_path,
+        const char* updates_path
+        ) {
+      auto E = generic_read<edges_store, std::vector<Edge>>(ctx, file_path);
+      Return bc;
+      if (base_path) {
+        MICROPROF_START(reading_base);
+        std::ifstream in(base_path);
+        if (!in.good()) {
+          fprintf(stderr, "Cannot read %s\n", base_path);
+          std::exit(EXIT_FAILURE);
+        }
+        typename Return::value_type score;
+        while (in >> score) {
+          bc.push_back(score);
+        }
+        MICROPROF_END(reading_base);
+      } else {
+        Edge::VertexId n = 0;
+        for (auto& e : E) {
+          n = std::max(n, std::max(e.v1_, e.v2_) + 1);
+        }
+        /* Edges are kept for updates. */
+        const std::vector<Edge>& edges = E;
+        bc = E.empty() ? EmptyGraph<Return>::result(n)
+          : Pipe().template cont<Return>(ctx, n, edges);
+      }
+      for (auto& e : E) {
+        if (static_cast<size_t>(std::max(e.v1_, e.v2_)) >= bc.size()) {
+          fprintf(stderr, "Cannot read %s: %zu scores do not cover vertex %d\n",
+              base_path, bc.size(), std::max(e.v1_, e.v2_));
+          std::exit(EXIT_FAILURE);
+        }
+      }
+      incremental_bc<> engine(ctx, E, bc);
+      for (auto& batch : read_updates(updates_path)) {
+        engine.update(ctx, batch);
+      }
+      return Return(engine.bc_.begin(), engine.bc_.end());
+    }
+
+}  // namespace brandes
+
+#endif  // BRANDESINCREMENTAL_H_
@@ -0,0 +1,338 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESKADABRA_H_
+#define BRANDESKADABRA_H_
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <future>
+#include <random>
+#include <algorithm>
+
+#include "./BrandesOutput.h"
+
+namespace brandes {
+
+  /** Picks uniformly random shortest paths with balanced bidirectional BFS,
+   * visited marks are stamped so that a sample costs only what it visits. */
+  template<typename VertexList> struct PathSampler {
+    typedef typename VertexList::value_type VertexId;
+    const VertexList& ptr_;
+    const VertexList& adj_;
+    std::vector<uint32_t> stamp_[2];
+    VertexList dist_[2];
+    std::vector<double> sigma_[2];
+    VertexList level_[2];
+    VertexList next_;
+    VertexList middle_;
+    uint32_t now_;
+
+    PathSampler(const VertexList __pass__ ptr, const VertexList __pass__ adj) :
+      ptr_(ptr), adj_(adj), now_(0)
+    {
+      const VertexId n = ptr.size() - 1;
+      for (int side = 0; side < 2; side++) {
+        stamp_[side].assign(n, 0);
+        dist_[side].resize(n);
+        sigma_[side].resize(n);
+      }
+    }
+
+    inline bool seen(const int side, const VertexId v) const {
+      return stamp_[side][v] == now_;
+    }
+
+    inline VertexId volume(const VertexList __pass__ level) const {
+      VertexId vol = 0;
+      for (auto v : level) {
+        vol += ptr_[v + 1] - ptr_[v];
+      }
+      return vol;
+    }
+
+    /* Steps from v towards the root of given side. */
+    template<typename Counts, typename Random>
+      inline void walk(int side, VertexId v, Counts __pass__ counts,
+          Random __pass__ rng) {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        while (dist_[side][v] > 0) {
+          double r = uniform(rng) * sigma_[side][v];
+          VertexId pred = -1;
+          for (VertexId i = ptr_[v], iN = ptr_[v + 1]; i < iN; i++) {
+            VertexId x = adj_[i];
+            if (seen(side, x) && dist_[side][x] + 1 == dist_[side][v]) {
+              pred = x;
+              if ((r -= sigma_[side][x]) < 0) {
+                break;
+              }
+            }
+          }
+          assert(pred >= 0);
+          v = pred;
+          if (dist_[side][v] > 0) {
+            counts[v] += 1.0;
+          }
+        }
+      }
+
+    /** Adds one to interior vertices of a random shortest s-t path, returns
+     * false if t is unreachable. */
+    template<typename Counts, typename Random>
+      inline bool sample(
+          const VertexId s,
+          const VertexId t,
+          Counts __pass__ counts,
+          Random __pass__ rng
+          ) {
+        assert(s != t);
+        if (++now_ == 0) {
+          for (int side = 0; side < 2; side++) {
+            std::fill(stamp_[side].begin(), stamp_[side].end(), 0);
+          }
+          now_ = 1;
+        }
+        const VertexId root[2] = { s, t };
+        for (int side = 0; side < 2; side++) {
+          stamp_[side][root[side]] = now_;
+          dist_[side][root[side]] = 0;
+          sigma_[side][root[side]] = 1.0;
+          level_[side].assign(1, root[side]);
+        }
+        middle_.clear();
+        int side;
+        /* The first level which touches the other side lies in the middle of
+         * all shortest paths. */
+        do {
+          side = volume(level_[0]) <= volume(level_[1]) ? 0 : 1;
+          if (level_[side].empty()) {
+            return false;
+          }
+          next_.clear();
+          for (auto u : level_[side]) {
+            for (VertexId i = ptr_[u], iN = ptr_[u + 1]; i < iN; i++) {
+              VertexId w = adj_[i];
+              if (!seen(side, w)) {
+                stamp_[side][w] = now_;
+                dist_[side][w] = dist_[side][u] + 1;
+                sigma_[side][w] = sigma_[side][u];
+                next_.push_back(w);
+                if (seen(side ^ 1, w)) {
+                  middle_.push_back(w);
+                }
+              } else if (dist_[side][w] == dist_[side][u] + 1) {
+                sigma_[side][w] += sigma_[side][u];
+              }
+            }
+          }
+          level_[side].swap(next_);
+        } while (middle_.empty());
+        double total = 0.0;
+        for (auto w : middle_) {
+          total += sigma_[0][w] * sigma_[1][w];
+        }
+        std::uniform_real_distribution<double> uniform(0.0, total);
+        double r = uniform(rng);
+        VertexId mid = middle_.back();
+        for (auto w : middle_) {
+          if ((r -= sigma_[0][w] * sigma_[1][w]) < 0) {
+            mid = w;
+            break;
+          }
+        }
+        if (mid != s && mid != t) {
+          counts[mid] += 1.0;
+        }
+        walk(0, mid, counts, rng);
+        walk(1, mid, counts, rng);
+        return true;
+      }
+  };
+
+  /** Top-k betweenness by adaptive sampling of shortest paths (KADABRA by
+   * Borassi and Natale), takes place of deg1_reduce and everything below it.
+   * Trees are contracted as usual and contribute exact scores, pairs of the
+   * remaining vertices are sampled proportionally to their weights. Sampling
+   * stops once confidence intervals separate the top-k vertices from the
+   * rest, or when every estimate is within lambda of the truth (relative to
+   * the number of weighted pairs). */
+  struct kadabra_topk {
+    template<typename Return, typename VertexList>
+      static std::vector<double> sample_worker(
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const Return __pass__ weight,
+          const std::vector<double> __pass__ cumulative,
+          const int64_t samples,
+          const uint64_t seed
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        const double total = cumulative.back();
+        std::vector<double> counts(n, 0.0);
+        PathSampler<VertexList> sampler(ptr, adj);
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, total);
+        auto pick = [&]() -> VertexId {
+          VertexId v = std::upper_bound(cumulative.begin(), cumulative.end(),
+              uniform(rng)) - cumulative.begin();
+          return std::min(v, n - 1);
+        };
+        for (int64_t i = 0; i < samples; i++) {
+          const VertexId s = pick(), t = pick();
+          /* Trees hanging off t are reached through t. */
+          if (s != t && sampler.sample(s, t, counts, rng)) {
+            counts[t] += (weight[t] - 1) / weight[t];
+          }
+        }
+        return counts;
+      }
+
+    /* Upper bound of vertex diameter, twice the eccentricity of any vertex
+     * in each component. */
+    template<typename VertexList>
+      static inline typename VertexList::value_type vertex_diameter(
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        VertexList dist(n, -1), queue(n);
+        VertexId vd = 1;
+        for (VertexId root = 0; root < n; root++) {
+          if (dist[root] >= 0) {
+            continue;
+          }
+          auto qfront = queue.begin(), qback = qfront;
+          dist[root] = 0;
+          *qback++ = root;
+          VertexId ecc = 0;
+          while (qfront != qback) {
+            VertexId v = *qfront++;
+            ecc = dist[v];
+            for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+              if (dist[adj[i]] < 0) {
+                dist[adj[i]] = dist[v] + 1;
+                *qback++ = adj[i];
+              }
+            }
+          }
+          vd = std::max(vd, 2 * ecc + 1);
+        }
+        return vd;
+      }
+
+    template<typename Return, typename VertexList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          const VertexList __pass__ ccs
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        assert(ctx.topk_ > 0);
+        assert(0 < ctx.topk_delta_ && ctx.topk_delta_ < 1);
+        assert(ctx.topk_lambda_ > 0);
+        MICROPROF_START(deg1_reduction);
+        MICROMEM_BEGIN(deg1_reduction);
+        const VertexId n0 = ptr.size() - 1;
+        Return bc, weight;
+        VertexList newind;
+        deg1_reduce<kadabra_topk>::contract(ctx.pool(), ctx.low_memory_, ptr,
+            adj, ccs, bc, weight, newind, [](VertexId, VertexId) {});
+        MICROMEM_END(deg1_reduction);
+        MICROPROF_END(deg1_reduction);
+        fprintf(stderr, "0\n0\n");
+        if (adj.empty()) {
+          return bc;
+        }
+        MICROPROF_START(kadabra_sampling);
+        const VertexId n = ptr.size() - 1;
+        std::vector<double> cumulative(n);
+        double total = 0.0;
+        for (VertexId v = 0; v < n; v++) {
+          cumulative[v] = (total += weight[v]);
+        }
+        const double scale = total * total;
+        /* Sample count which guarantees lambda error for every vertex. */
+        const VertexId vd = vertex_diameter(ptr, adj);
+        const double omega = 0.5 / (ctx.topk_lambda_ * ctx.topk_lambda_) *
+          ((vd > 2 ? std::floor(std::log2(vd - 2)) : 0) + 1 +
+           std::log(2 / ctx.topk_delta_));
+        const double log_delta = std::log(2.0 * n0 / ctx.topk_delta_);
+        MICROPROF_INFO("KADABRA:\tvertex diameter bound\t%d\n", vd);
+        MICROPROF_INFO("KADABRA:\tmaximal samples\t%.0f\n", omega);
+        /* Vertices removed by contraction have exact scores. */
+        std::vector<VertexId> core(n);
+        for (VertexId v = 0; v < n0; v++) {
+          if (newind[v] >= 0) {
+            core[newind[v]] = v;
+          }
+        }
+        const VertexId k = std::min<VertexId>(ctx.topk_, n0);
+        std::vector<double> counts(n, 0.0), lower(n0), upper(n0), point(n0);
+        std::vector<VertexId> ids(n0);
+        std::random_device seeder;
+        const int jobs = std::max(ctx.kCPUJobs_, 1);
+        int64_t tau = 0, batch = 1000;
+        bool certified = false;
+        while (!certified && tau < omega) {
+          std::vector<std::future<std::vector<double>>> workers;
+          for (int j = 0; j < jobs; j++) {
+            const uint64_t seed = (static_cast<uint64_t>(seeder()) << 32) ^
+              seeder();
+            workers.push_back(ctx.pool().submit([&, seed]() {
+                  return sample_worker<Return, VertexList>(ptr, adj, weight,
+                    cumulative, batch, seed);
+                  }));
+          }
+          for (auto& worker : workers) {
+            auto counts1 = worker.get();
+            for (VertexId v = 0; v < n; v++) {
+              counts[v] += counts1[v];
+            }
+          }
+          tau += batch * jobs;
+          batch = std::min<int64_t>(batch * 2, 1 << 16);
+          /* Confidence intervals of final scores. */
+          const double ratio = omega / tau;
+          for (VertexId v = 0; v < n0; v++) {
+            lower[v] = upper[v] = point[v] = bc[v];
+            ids[v] = v;
+          }
+          for (VertexId c = 0; c < n; c++) {
+            const VertexId v = core[c];
+            const double b = counts[c] / tau;
+            const double f = log_delta / tau * (1.0 / 3 - ratio + std::sqrt(
+                  (1.0 / 3 - ratio) * (1.0 / 3 - ratio) +
+                  2 * b * omega / log_delta));
+            const double g = log_delta / tau * (1.0 / 3 + ratio + std::sqrt(
+                  (1.0 / 3 + ratio) * (1.0 / 3 + ratio) +
+                  2 * b * omega / log_delta));
+            point[v] += scale * b;
+            lower[v] += scale * std::max(b - f, 0.0);
+            upper[v] += scale * (b + g);
+          }
+          std::nth_element(ids.begin(), ids.begin() + (k - 1), ids.end(),
+              [&point](VertexId a, VertexId b) { return point[a] > point[b]; });
+          double top_lower = upper[ids[0]], rest_upper = 0.0;
+          for (VertexId i = 0; i < n0; i++) {
+            if (i < k) {
+              top_lower = std::min(top_lower, lower[ids[i]]);
+            } else {
+              rest_upper = std::max(rest_upper, upper[ids[i]]);
+            }
+          }
+          certified = top_lower >= rest_upper;
+        }
+        MICROPROF_INFO("KADABRA:\tsamples taken\t%ld\n",
+            static_cast<long>(tau));
+        MICROPROF_INFO("KADABRA:\ttop-k certified\t%d\n", certified);
+        MICROPROF_END(kadabra_sampling);
+        return Return(point.begin(), point.end());
+      }
+  };
+
+}  // namespace brandes
+
+#endif  // BRANDESKADABRA_H_
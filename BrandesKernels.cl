@@ -6,6 +6,17 @@ inline int divide_up(
   return (value + (1 << factor) - 1) >> factor;
 }
 
+/* Whether a vertex at distance du precedes one at dw over an edge of length
+ * l, half is half of the shortest length, as sssp_precedes on the host. */
+inline bool precedes(
+    float du,
+    float l,
+    float dw,
+    float half) {
+  return du < dw && du <= dw - half &&
+    fabs(du + l - dw) <= 16 * FLT_EPSILON * dw;
+}
+
 /** Brandes' kernels. */
 __kernel void vcsr_init_n(
     const int global_id_range,
@@ -34,15 +45,19 @@ __kernel void vcsr_init_n1(
   }
 }
 
-__kernel void vcsr_init_source(
+/* Every component runs its own source (or none if its root is -1), other
+ * kernels only ever compare distances of adjacent vertices. */
+__kernel void vcsr_init_sources(
     const int global_id_range,
-    const int source,
     __global bool* proceed,
+    __global int* comp,
+    __global int* roots,
     __global int* dist,
     __global int* sigma
     ) {
   const int my_i = get_global_id(0);
   if (my_i < global_id_range) {
+    const int source = roots[comp[my_i]];
     dist[my_i] = select(-1, 0, source == my_i);
     sigma[my_i] = select(0, 1, source == my_i);
   }
@@ -168,9 +183,10 @@ __kernel void vcsr_backward_reduce(
   }
 }
 
-__kernel void vcsr_sum(
+__kernel void vcsr_sum_sources(
     const int global_id_range,
-    const int source,
+    __global int* comp,
+    __global int* roots,
     __global float* weight,
     __global int* dist,
     __global int* sigma,
@@ -178,8 +194,245 @@ __kernel void vcsr_sum(
     __global float* bc
     ) {
   const int my_i = get_global_id(0);
-  if (my_i < global_id_range && my_i != source && dist[my_i] != -1) {
-    bc[my_i] += (delta[my_i] * sigma[my_i] - 1) * weight[source];
+  if (my_i < global_id_range && dist[my_i] != -1) {
+    const int source = roots[comp[my_i]];
+    if (my_i != source) {
+      bc[my_i] += (delta[my_i] * sigma[my_i] - 1) * weight[source];
+    }
+  }
+}
+
+
+/** Weighted Brandes' kernels, distances are settled bucket by bucket and then
+ * path counts and dependencies are propagated along shortest-path DAG until
+ * they stabilize. Lengths are positive so their bit patterns are ordered. */
+__kernel void wcsr_init_source(
+    const int global_id_range,
+    const int source,
+    __global bool* proceed,
+    __global float* dist,
+    __global int* sigma,
+    __global char* dirty
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range) {
+    dist[my_i] = (source == my_i) ? 0.0f : FLT_MAX;
+    sigma[my_i] = select(0, 1, source == my_i);
+    dirty[my_i] = select(0, 1, source == my_i);
+  }
+  *proceed = false;
+}
+
+__kernel void wcsr_relax(
+    const int global_id_range,
+    const float bound,
+    const int kMDegLog2,
+    __global bool* proceed,
+    __global int* vmap,
+    __global int* voff,
+    __global int* ptr,
+    __global int* adj,
+    __global float* len,
+    __global float* dist,
+    __global char* dirty_in,
+    __global char* dirty_out
+    ) {
+  const int my_vi = get_global_id(0);
+  if (my_vi < global_id_range) {
+    const int my_map = vmap[my_vi];
+    const float my_d = dist[my_map];
+    if (dirty_in[my_map] && my_d < bound) {
+      int my_ptr = ptr[my_map];
+      const int next_ptr = ptr[my_map + 1];
+      const int my_cnt = divide_up(next_ptr - my_ptr, kMDegLog2);
+      my_ptr += voff[my_vi];
+      for (; my_ptr < next_ptr; my_ptr += my_cnt) {
+        const int other_i = adj[my_ptr];
+        const float other_d = my_d + len[my_ptr];
+        const int old_d = atomic_min((volatile __global int*) (dist + other_i),
+            as_int(other_d));
+        if (as_int(other_d) < old_d) {
+          dirty_out[other_i] = 1;
+          if (other_d < bound) {
+            *proceed = true;
+          }
+        }
+      }
+    }
   }
 }
 
+__kernel void wcsr_carry(
+    const int global_id_range,
+    const float bound,
+    __global bool* proceed,
+    __global float* dist,
+    __global char* dirty_in,
+    __global char* dirty_out
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range) {
+    if (dirty_in[my_i]) {
+      if (dist[my_i] >= bound) {
+        dirty_out[my_i] = 1;
+      }
+      dirty_in[my_i] = 0;
+    }
+  }
+  *proceed = false;
+}
+
+__kernel void wcsr_next_bucket(
+    const int global_id_range,
+    __global float* dist,
+    __global char* dirty,
+    __global int* next_min
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range) {
+    if (dirty[my_i]) {
+      atomic_min(next_min, as_int(dist[my_i]));
+    }
+  }
+}
+
+__kernel void wcsr_sigma(
+    const int global_id_range,
+    const int kMDegLog2,
+    const float half,
+    __global bool* proceed,
+    __global int* vmap,
+    __global int* voff,
+    __global int* ptr,
+    __global int* adj,
+    __global float* len,
+    __global float* dist,
+    __global int* sigma,
+    __global int* red
+    ) {
+  const int my_vi = get_global_id(0);
+  if (my_vi < global_id_range) {
+    const int my_map = vmap[my_vi];
+    const float my_d = dist[my_map];
+    if (my_d != FLT_MAX) {
+      int my_ptr = ptr[my_map];
+      const int next_ptr = ptr[my_map + 1];
+      const int my_cnt = divide_up(next_ptr - my_ptr, kMDegLog2);
+      my_ptr += voff[my_vi];
+      int sum = 0;
+      for (; my_ptr < next_ptr; my_ptr += my_cnt) {
+        const int other_i = adj[my_ptr];
+        if (precedes(dist[other_i], len[my_ptr], my_d, half)) {
+          sum += sigma[other_i];
+        }
+      }
+      red[my_vi] = sum;
+    }
+  }
+  *proceed = false;
+}
+
+__kernel void wcsr_sigma_reduce(
+    const int global_id_range,
+    const int source,
+    __global bool* proceed,
+    __global int* rmap,
+    __global float* weight,
+    __global float* dist,
+    __global int* sigma,
+    __global float* delta,
+    __global int* red
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range && dist[my_i] != FLT_MAX) {
+    int sum = 1;
+    if (my_i != source) {
+      int next_i = rmap[my_i];
+      const int last_i = rmap[my_i + 1];
+      for (sum = 0; next_i < last_i; next_i++) {
+        sum += red[next_i];
+      }
+    }
+    if (sum != sigma[my_i]) {
+      sigma[my_i] = sum;
+      *proceed = true;
+    }
+    delta[my_i] = weight[my_i] / sum;
+  }
+}
+
+__kernel void wcsr_delta(
+    const int global_id_range,
+    const int kMDegLog2,
+    const float half,
+    __global bool* proceed,
+    __global int* vmap,
+    __global int* voff,
+    __global int* ptr,
+    __global int* adj,
+    __global float* len,
+    __global float* dist,
+    __global float* delta,
+    __global float* red
+    ) {
+  const int my_vi = get_global_id(0);
+  if (my_vi < global_id_range) {
+    const int my_map = vmap[my_vi];
+    const float my_d = dist[my_map];
+    if (my_d != FLT_MAX) {
+      int my_ptr = ptr[my_map];
+      const int next_ptr = ptr[my_map + 1];
+      const int my_cnt = divide_up(next_ptr - my_ptr, kMDegLog2);
+      my_ptr += voff[my_vi];
+      float sum = 0.0f;
+      for (; my_ptr < next_ptr; my_ptr += my_cnt) {
+        const int other_i = adj[my_ptr];
+        if (precedes(my_d, len[my_ptr], dist[other_i], half)) {
+          sum += delta[other_i];
+        }
+      }
+      red[my_vi] = sum;
+    }
+  }
+  *proceed = false;
+}
+
+__kernel void wcsr_delta_reduce(
+    const int global_id_range,
+    __global bool* proceed,
+    __global int* rmap,
+    __global float* weight,
+    __global float* dist,
+    __global int* sigma,
+    __global float* delta,
+    __global float* red
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range && dist[my_i] != FLT_MAX) {
+    int next_i = rmap[my_i];
+    const int last_i = rmap[my_i + 1];
+    float sum = weight[my_i] / sigma[my_i];
+    for (; next_i < last_i; next_i++) {
+      sum += red[next_i];
+    }
+    if (sum != delta[my_i]) {
+      delta[my_i] = sum;
+      *proceed = true;
+    }
+  }
+}
+
+__kernel void wcsr_sum(
+    const int global_id_range,
+    const int source,
+    __global float* weight,
+    __global float* dist,
+    __global int* sigma,
+    __global float* delta,
+    __global float* bc
+    ) {
+  const int my_i = get_global_id(0);
+  if (my_i < global_id_range && my_i != source && dist[my_i] != FLT_MAX) {
+    bc[my_i] += (delta[my_i] * sigma[my_i] - 1) * weight[source];
+  }
+}
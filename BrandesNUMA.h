@@ -0,0 +1,155 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESNUMA_H_
+#define BRANDESNUMA_H_
+
+#include <cassert>
+#include <vector>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <algorithm>
+
+#include "./BrandesProgress.h"
+
+namespace brandes {
+
+  /** Read-only list with a copy for every node, each copy is made on first
+   * use by a thread running on its node so that the pages are allocated
+   * there. With a single node the original is shared. */
+  template<typename List> class NodeReplicas {
+    private:
+      const List& kOrigin_;
+      std::unique_ptr<std::once_flag[]> once_;
+      std::vector<List> copies_;
+
+    public:
+      NodeReplicas(const List& origin, const int nodes) :
+        kOrigin_(origin),
+        once_(nodes > 1 ? new std::once_flag[nodes] : nullptr),
+        copies_(nodes > 1 ? nodes : 0) {}
+
+      inline const List& get(const int node) {
+        if (copies_.empty()) {
+          return kOrigin_;
+        }
+        std::call_once(once_[node], [this, node]() {
+            copies_[node] = kOrigin_;
+            });
+        return copies_[node];
+      }
+  };
+
+  /** Runs CPU workers as tasks of a pool and sums their results along a
+   * binomial tree. Pairs of partial sums are added by whichever of the two
+   * workers finishes later, into the accumulator of the lower one, so that
+   * summation takes logarithmically many parallel rounds and no task waits
+   * for another. Work is called with the node of the pool thread which runs
+   * it and the index of the worker. */
+  template<typename Return> class WorkerTree {
+    private:
+      const int kJobs_;
+      int levels_;
+      std::vector<Return> partials_;
+      /* Arrivals at every pair of every level. */
+      std::unique_ptr<std::atomic<int>[]> arrived_;
+      std::mutex mutex_;
+      std::exception_ptr error_;
+      /* Shared with the last worker, which may still be setting it when the
+       * tree is destroyed. */
+      std::shared_ptr<std::promise<Return>> total_;
+      std::future<Return> result_;
+
+      static inline void add(Return __pass__ sum, const Return __pass__ part) {
+        assert(sum.size() == part.size());
+        auto itsum = sum.begin();
+        auto itpart = part.begin();
+        const auto itsumN = sum.end();
+        while (itsum != itsumN) {
+          *itsum++ += *itpart++;
+        }
+      }
+
+      inline void climb(int i) {
+        MICROPROF_START(cpu_worker_reduce);
+        for (int step = 1, level = 0; step < kJobs_; step <<= 1, level++) {
+          const int lo = i & ~(2 * step - 1);
+          if (lo + step >= kJobs_) {
+            continue;
+          }
+          if (arrived_[level * kJobs_ + lo].fetch_add(1) == 0) {
+            return;
+          }
+          /* Partial sum of a failed worker is empty. */
+          Return& sum = partials_[lo];
+          Return& part = partials_[lo + step];
+          if (sum.empty()) {
+            sum.swap(part);
+          } else if (!part.empty()) {
+            add(sum, part);
+          }
+          Return().swap(part);
+          i = lo;
+        }
+        MICROPROF_END(cpu_worker_reduce);
+        auto total = total_;
+        if (error_) {
+          total->set_exception(error_);
+        } else {
+          total->set_value(std::move(partials_[0]));
+        }
+      }
+
+    public:
+      template<typename Work>
+        WorkerTree(WorkerPool& pool, const int jobs, Work work) :
+          kJobs_(jobs),
+          levels_(0),
+          partials_(jobs),
+          total_(std::make_shared<std::promise<Return>>()),
+          result_(total_->get_future()) {
+          while ((1 << levels_) < jobs) {
+            levels_++;
+          }
+          arrived_.reset(new std::atomic<int>[levels_ * jobs + 1]);
+          for (int k = 0; k < levels_ * jobs; k++) {
+            arrived_[k] = 0;
+          }
+          for (int i = 0; i < jobs; i++) {
+            pool.submit([this, work, i]() {
+                try {
+                  partials_[i] = work(WorkerPool::node(), i);
+                } catch (...) {
+                  std::lock_guard<std::mutex> lock(mutex_);
+                  error_ = std::current_exception();
+                }
+                climb(i);
+                });
+          }
+        }
+
+      ~WorkerTree() {
+        if (result_.valid() && kJobs_ > 0) {
+          result_.wait();
+        }
+      }
+
+      WorkerTree(const WorkerTree&) = delete;
+      WorkerTree& operator=(const WorkerTree&) = delete;
+
+      inline int size() const {
+        return kJobs_;
+      }
+
+      /** Sum of results of all workers, waits for them to finish. */
+      inline Return sum() {
+        assert(size() > 0);
+        return result_.get();
+      }
+  };
+
+}  // namespace brandes
+
+#endif  // BRANDESNUMA_H_
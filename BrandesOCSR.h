@@ -3,6 +3,8 @@
 #define BRANDESOCSR_H_
 
 #include <cassert>
+#include <cstdint>
+#include <utility>
 #include <algorithm>
 
 #include "./BrandesCSR.h"
@@ -10,42 +12,117 @@
 namespace brandes {
 
   template<typename Cont> struct ocsr_create {
-    template<typename Return, typename VertexList>
-      inline Return cont(
-          Context& ctx,
+    /* Root of a tree of the union-find forest, halving the path. */
+    template<typename VertexId>
+      static inline VertexId find(VertexId* parent, VertexId v) {
+        VertexId p;
+        while ((p = __atomic_load_n(&parent[v], __ATOMIC_RELAXED)) != v) {
+          const VertexId up = __atomic_load_n(&parent[p], __ATOMIC_RELAXED);
+          __atomic_store_n(&parent[v], up, __ATOMIC_RELAXED);
+          v = up;
+        }
+        return v;
+      }
+
+    /* The larger root is linked under the smaller one, so that every
+     * component ends up rooted at its lowest vertex. */
+    template<typename VertexId>
+      static inline void unite(VertexId* parent, VertexId a, VertexId b) {
+        for (;;) {
+          a = find(parent, a);
+          b = find(parent, b);
+          if (a == b) {
+            return;
+          } else if (a < b) {
+            std::swap(a, b);
+          }
+          VertexId expected = a;
+          if (__atomic_compare_exchange_n(&parent[a], &expected, b, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return;
+          }
+        }
+      }
+
+    /** Numbers vertices in BFS order from the lowest vertex of every
+     * connected component, components ordered by their lowest vertices.
+     * Components are labelled concurrently and searched in parallel, each
+     * one in its own range of the order. */
+    template<typename VertexList>
+      static inline void order(
+          WorkerPool __pass__ pool,
           const VertexList __pass__ ptr,
-          const VertexList __pass__ adj
-          ) const {
+          const VertexList __pass__ adj,
+          VertexList __pass__ bfsno,
+          VertexList __pass__ queue,
+          VertexList __pass__ ccs
+          ) {
         typedef typename VertexList::value_type VertexId;
-        MICROPROF_START(bfs_ordering);
+        const int64_t kGrain = WorkerPool::kGrain;
         const VertexId n = ptr.size() - 1;
-        VertexList bfsno(n, -1), queue(n), ccs;
-        auto qfront = queue.begin(), qback = queue.begin();
-        VertexId bfsi = 0;
-        for (VertexId root = 0; root < n; root++) {
-          if (bfsno[root] >= 0) {
-            continue;
-          }
-          ccs.push_back(bfsi);
-          bfsno[root] = bfsi++;
-          *qback++ = root;
-          while (qfront != qback) {
-            VertexId curr = *qfront++;
-            assert(bfsno[curr] >= 0);
-            assert(static_cast<size_t>(n) + 1 == ptr.size());
-            auto next = adj.begin() + ptr[curr],
-                 last = adj.begin() + ptr[curr + 1];
-            while (next != last) {
-              VertexId neigh = *next++;
-              if (bfsno[neigh] >= 0) {
-                continue;
+        assert(static_cast<size_t>(n) + 1 == ptr.size());
+        VertexList parent(n), rank(n), base(n, 0);
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId v = lo; v < hi; v++) {
+              parent[v] = v;
+            }
+            });
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId v = lo; v < hi; v++) {
+              for (VertexId i = ptr[v]; i < ptr[v + 1]; i++) {
+                if (adj[i] < v) {
+                  unite(parent.data(), v, adj[i]);
+                }
               }
-              bfsno[neigh] = bfsi++;
-              *qback++ = neigh;
             }
-          }
-        }
-        ccs.push_back(bfsi);
+            });
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId v = lo; v < hi; v++) {
+              const VertexId root = find(parent.data(), v);
+              rank[v] = root == v;
+              __atomic_fetch_add(&base[root], 1, __ATOMIC_RELAXED);
+            }
+            });
+        /* Roots get their component index and its first BFS number. */
+        const VertexId count = pool.exclusive_scan(rank.begin(), rank.end());
+        pool.exclusive_scan(base.begin(), base.end());
+        VertexList roots(count);
+        ccs.resize(count + 1);
+        ccs[count] = n;
+        pool.parallel_for(0, n, kGrain, [&](int64_t lo, int64_t hi) {
+            for (VertexId v = lo; v < hi; v++) {
+              if (parent[v] == v) {
+                roots[rank[v]] = v;
+                ccs[rank[v]] = base[v];
+              }
+            }
+            });
+        bfsno.assign(n, -1);
+        queue.resize(n);
+        pool.parallel_for(0, count, 64, [&](int64_t lo, int64_t hi) {
+            for (VertexId cc = lo; cc < hi; cc++) {
+              const VertexId root = roots[cc];
+              auto qfront = queue.begin() + ccs[cc], qback = qfront;
+              VertexId bfsi = ccs[cc];
+              bfsno[root] = bfsi++;
+              *qback++ = root;
+              while (qfront != qback) {
+                VertexId curr = *qfront++;
+                assert(bfsno[curr] >= 0);
+                auto next = adj.begin() + ptr[curr],
+                     last = adj.begin() + ptr[curr + 1];
+                while (next != last) {
+                  VertexId neigh = *next++;
+                  if (bfsno[neigh] >= 0) {
+                    continue;
+                  }
+                  bfsno[neigh] = bfsi++;
+                  *qback++ = neigh;
+                }
+              }
+              assert(bfsi == ccs[cc + 1]);
+            }
+            });
 #ifndef NDEBUG
         for (auto no : bfsno) {
           assert(no >= 0);
@@ -56,22 +133,45 @@ namespace brandes {
         assert(std::is_sorted(ccs.begin(), ccs.end()));
         assert(ccs.back() == n);
 #endif  // NDEBUG
-        VertexList optr(ptr.size()), oadj(adj.size());
-        auto itoadj0 = oadj.begin(),
-             itoadj = itoadj0,
-             itoptr = optr.begin();
-        for (auto curr : queue) {
-          *itoptr++ = itoadj - itoadj0;
-          auto next = adj.begin() + ptr[curr],
-               last = adj.begin() + ptr[curr + 1];
-          while (next != last) {
-            *itoadj++ = bfsno[*next++];
-          }
-        }
-        *itoptr = itoadj - itoadj0;
+      }
+
+    template<typename VertexList>
+      static inline void relabel(
+          WorkerPool __pass__ pool,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const VertexList __pass__ bfsno,
+          const VertexList __pass__ queue,
+          VertexList __pass__ optr,
+          VertexList __pass__ oadj
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        optr.resize(ptr.size());
+        oadj.resize(adj.size());
+        pool.parallel_for(0, n, WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId ordv = lo; ordv < hi; ordv++) {
+              const VertexId curr = queue[ordv];
+              optr[ordv] = ptr[curr + 1] - ptr[curr];
+            }
+            });
+        optr[n] = 0;
+        pool.exclusive_scan(optr.begin(), optr.end());
+        pool.parallel_for(0, n, WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId ordv = lo; ordv < hi; ordv++) {
+              const VertexId curr = queue[ordv];
+              auto next = adj.begin() + ptr[curr],
+                   last = adj.begin() + ptr[curr + 1];
+              auto itoadj = oadj.begin() + optr[ordv];
+              while (next != last) {
+                *itoadj++ = bfsno[*next++];
+              }
+            }
+            });
 #ifndef NDEBUG
-        assert(static_cast<size_t>(*itoptr) == adj.size());
-        assert(itoptr + 1 == optr.end());
+        assert(static_cast<size_t>(optr[n]) == adj.size());
         for (VertexId orig = 0; orig < n; orig++) {
           VertexId ordv = bfsno[orig];
           assert(optr[ordv + 1] - optr[ordv] == ptr[orig + 1] - ptr[orig]);
@@ -83,14 +183,93 @@ namespace brandes {
           }
         }
 #endif  // NDEBUG
-        MICROPROF_END(bfs_ordering);
-        auto bc1 = CONT_BIND(ctx, optr, oadj, ccs);
+      }
+
+    /** Moves per-edge data (e.g. edge lengths) along with relabeled edges. */
+    template<typename VertexList, typename EdgeDataList>
+      static inline void relabel_edges(
+          WorkerPool __pass__ pool,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ queue,
+          const VertexList __pass__ optr,
+          const EdgeDataList __pass__ data,
+          EdgeDataList __pass__ odata
+          ) {
+        typedef typename VertexList::value_type VertexId;
+        const VertexId n = ptr.size() - 1;
+        odata.resize(data.size());
+        pool.parallel_for(0, n, WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId ordv = lo; ordv < hi; ordv++) {
+              const VertexId curr = queue[ordv];
+              std::copy(data.begin() + ptr[curr], data.begin() + ptr[curr + 1],
+                  odata.begin() + optr[ordv]);
+            }
+            });
+      }
+
+    template<typename Return, typename VertexList>
+      static inline Return restore(
+          WorkerPool __pass__ pool,
+          const Return __pass__ bc1,
+          const VertexList __pass__ bfsno
+          ) {
         Return bc(bc1.size());
-        for (VertexId orig = 0, end = bc1.size(); orig < end; orig++) {
-          bc[orig] = bc1[bfsno[orig]];
-        }
+        pool.parallel_for(0, bc1.size(), WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (int64_t orig = lo; orig < hi; orig++) {
+              bc[orig] = bc1[bfsno[orig]];
+            }
+            });
         return bc;
       }
+
+    template<typename Return, typename VertexList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj
+          ) const {
+        MICROPROF_START(bfs_ordering);
+        MICROMEM_BEGIN(bfs_ordering);
+        VertexList bfsno, queue, ccs, optr, oadj;
+        order(ctx.pool(), ptr, adj, bfsno, queue, ccs);
+        relabel(ctx.pool(), ptr, adj, bfsno, queue, optr, oadj);
+        release(ctx, queue);
+        release(ctx, ptr);
+        release(ctx, adj);
+        MICROMEM_END(bfs_ordering);
+        ctx.restrict_masks(bfsno.size(), [&bfsno](int v) { return bfsno[v]; });
+        MICROPROF_END(bfs_ordering);
+        auto bc1 = CONT_BIND(ctx, optr, oadj, ccs);
+        ctx.metrics_.restore(bfsno);
+        return restore(ctx.pool(), bc1, bfsno);
+      }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len
+          ) const {
+        MICROPROF_START(bfs_ordering);
+        MICROMEM_BEGIN(bfs_ordering);
+        VertexList bfsno, queue, ccs, optr, oadj;
+        LengthList olen;
+        order(ctx.pool(), ptr, adj, bfsno, queue, ccs);
+        relabel(ctx.pool(), ptr, adj, bfsno, queue, optr, oadj);
+        relabel_edges(ctx.pool(), ptr, queue, optr, len, olen);
+        release(ctx, queue);
+        release(ctx, ptr);
+        release(ctx, adj);
+        release(ctx, len);
+        MICROMEM_END(bfs_ordering);
+        ctx.restrict_masks(bfsno.size(), [&bfsno](int v) { return bfsno[v]; });
+        MICROPROF_END(bfs_ordering);
+        auto bc1 = CONT_BIND(ctx, optr, oadj, olen, ccs);
+        return restore(ctx.pool(), bc1, bfsno);
+      }
   };
 
   template<typename Cont> struct ocsr_pass {
@@ -104,9 +283,26 @@ namespace brandes {
         MICROPROF_START(bfs_ordering);
         const VertexId n = ptr.size() - 1;
         VertexList ccs = { 0, n };
+        ctx.restrict_masks(n, [](int v) { return v; });
         MICROPROF_END(bfs_ordering);
         return CONT_BIND(ctx, ptr, adj, ccs);
       }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len
+          ) const {
+        typedef typename VertexList::value_type VertexId;
+        MICROPROF_START(bfs_ordering);
+        const VertexId n = ptr.size() - 1;
+        VertexList ccs = { 0, n };
+        ctx.restrict_masks(n, [](int v) { return v; });
+        MICROPROF_END(bfs_ordering);
+        return CONT_BIND(ctx, ptr, adj, len, ccs);
+      }
   };
 
 }  // namespace brandes
@@ -0,0 +1,186 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESOUTPUT_H_
+#define BRANDESOUTPUT_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "./BrandesDaemon.h"
+
+namespace brandes {
+
+  /** Formats chunks of scores on the pool, a few chunks per thread at a
+   * time, and writes them in order. Output is identical to printing "%f\n"
+   * per vertex. */
+  template<typename Result>
+    inline void write_text(
+        WorkerPool& pool,
+        const Result __pass__ res,
+        FILE* fp
+        ) {
+      const int64_t kChunk = 1 << 16;
+      const int64_t n = res.size();
+      const int64_t round = 2 * pool.size() * kChunk;
+      std::vector<std::vector<char>> bufs(std::min<int64_t>(
+            (n + kChunk - 1) / kChunk, 2 * pool.size()));
+      for (int64_t begin = 0; begin < n; begin += round) {
+        const int64_t end = std::min(begin + round, n);
+        pool.parallel_for(begin, end, kChunk, [&](int64_t lo, int64_t hi) {
+            std::vector<char>& buf = bufs[(lo - begin) / kChunk];
+            buf.clear();
+            buf.reserve((hi - lo) * 16);
+            char tmp[512];
+            for (int64_t v = lo; v < hi; v++) {
+              int len = snprintf(tmp, sizeof(tmp), "%f\n",
+                  static_cast<double>(res[v]));
+              assert(len > 0 && static_cast<size_t>(len) < sizeof(tmp));
+              buf.insert(buf.end(), tmp, tmp + len);
+            }
+            });
+        for (int64_t lo = begin; lo < end; lo += kChunk) {
+          const std::vector<char>& buf = bufs[(lo - begin) / kChunk];
+          fwrite(buf.data(), 1, buf.size(), fp);
+        }
+      }
+    }
+
+  /** Raw dump of scores converted to Out in native byte order. */
+  template<typename Out, typename Result>
+    inline void write_binary(
+        const Result __pass__ res,
+        const char* file_path,
+        const bool use_mmap
+        ) {
+      const size_t bytes = res.size() * sizeof(Out);
+      if (use_mmap && bytes > 0) {
+        /* Created like fopen would, i.e. 0666 before umask. */
+        const int fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        void* addr = MAP_FAILED;
+        if (fd >= 0 && ftruncate(fd, bytes) == 0) {
+          addr = mmap(nullptr, bytes, PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (addr != MAP_FAILED) {
+          Out* out = reinterpret_cast<Out*>(addr);
+          for (size_t v = 0; v < res.size(); v++) {
+            out[v] = res[v];
+          }
+          munmap(addr, bytes);
+          close(fd);
+          return;
+        }
+        fprintf(stderr, "Cannot map %s, writing it without mmap.\n",
+            file_path);
+        if (fd >= 0) {
+          close(fd);
+        }
+      }
+      FILE* fp = fopen(file_path, "wb");
+      assert(fp);
+      std::vector<Out> out(res.begin(), res.end());
+      fwrite(out.data(), sizeof(Out), out.size(), fp);
+      fclose(fp);
+    }
+
+  /** Writes "id score" lines of k highest-scoring vertices, ties are broken
+   * by lower id. */
+  template<typename Result>
+    inline void write_top(const Result __pass__ res, FILE* fp, size_t k) {
+      std::vector<int> ids(res.size());
+      for (size_t v = 0; v < ids.size(); v++) {
+        ids[v] = v;
+      }
+      k = std::min(k, ids.size());
+      auto higher = [&res](int a, int b) {
+        return res[a] > res[b] || (res[a] == res[b] && a < b);
+      };
+      std::partial_sort(ids.begin(), ids.begin() + k, ids.end(), higher);
+      for (size_t i = 0; i < k; i++) {
+        fprintf(fp, "%d %f\n", ids[i], static_cast<double>(res[ids[i]]));
+      }
+    }
+
+  /** Modes: text (default), float, double, float-mmap, double-mmap, top:k
+   * with positive k. */
+  template<typename Result>
+    inline void generic_write(
+        Context& ctx,
+        const Result __pass__ res,
+        const char* file_path,
+        const char* mode
+        ) {
+      MICROPROF_START(writing_results);
+      mode = mode ? mode : "text";
+      if (std::strcmp(mode, "float") == 0 ||
+          std::strcmp(mode, "float-mmap") == 0) {
+        write_binary<float>(res, file_path, mode[5] == '-');
+      } else if (std::strcmp(mode, "double") == 0 ||
+          std::strcmp(mode, "double-mmap") == 0) {
+        write_binary<double>(res, file_path, mode[6] == '-');
+      } else {
+        FILE* fp = fopen(file_path, "w");
+        assert(fp);
+        char* end = nullptr;
+        const size_t k = std::strncmp(mode, "top:", 4) == 0 &&
+          isdigit(mode[4]) ? std::strtoul(mode + 4, &end, 10) : 0;
+        if (k > 0 && *end == '\0') {
+          write_top(res, fp, k);
+        } else {
+          if (std::strcmp(mode, "text") != 0) {
+            fprintf(stderr, "Unknown output mode %s, writing text.\n", mode);
+          }
+          write_text(ctx.pool(), res, fp);
+        }
+        fclose(fp);
+      }
+      MICROPROF_END(writing_results);
+    }
+
+  /** Writes every computed metric next to betweenness, to files named
+   * <path>.closeness, <path>.harmonic, <path>.stress (text, one score per
+   * vertex) and <path>.edges ("u v score" per edge, u < v). */
+  inline void write_metrics(Context& ctx, const char* path) {
+    const Metrics& metrics = ctx.metrics_;
+    if (!metrics.requested_) {
+      return;
+    }
+    MICROPROF_START(writing_metrics);
+    const std::string base(path);
+    const std::pair<unsigned, const char*> files[] = {
+      std::make_pair(Metrics::kCloseness, ".closeness"),
+      std::make_pair(Metrics::kHarmonic, ".harmonic"),
+      std::make_pair(Metrics::kStress, ".stress"),
+    };
+    const std::vector<double>* scores[] = { &metrics.closeness_,
+      &metrics.harmonic_, &metrics.stress_ };
+    for (int k = 0; k < 3; k++) {
+      if (metrics.requested_ & files[k].first) {
+        FILE* fp = fopen((base + files[k].second).c_str(), "w");
+        assert(fp);
+        write_text(ctx.pool(), *scores[k], fp);
+        fclose(fp);
+      }
+    }
+    if (metrics.requested_ & Metrics::kEdge) {
+      FILE* fp = fopen((base + ".edges").c_str(), "w");
+      assert(fp);
+      for (size_t i = 0; i < metrics.edges_.size(); i++) {
+        fprintf(fp, "%d %d %f\n", metrics.edges_[i].first,
+            metrics.edges_[i].second, metrics.edge_bc_[i]);
+      }
+      fclose(fp);
+    }
+    MICROPROF_END(writing_metrics);
+  }
+
+}  // namespace brandes
+
+#endif  // BRANDESOUTPUT_H_
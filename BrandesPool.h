@@ -0,0 +1,409 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESPOOL_H_
+#define BRANDESPOOL_H_
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <algorithm>
+
+#include "./BrandesAlloc.h"
+
+namespace brandes {
+
+  /** NUMA nodes which have CPUs this process may run on, read from sysfs.
+   * Without NUMA (or sysfs) the machine is a single node. */
+  class NumaTopology {
+    private:
+      cpu_set_t allowed_;
+      std::vector<cpu_set_t> nodes_;
+
+      NumaTopology() {
+        CPU_ZERO(&allowed_);
+        if (sched_getaffinity(0, sizeof(allowed_), &allowed_) != 0) {
+          for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &allowed_);
+          }
+        }
+        std::vector<std::pair<int, cpu_set_t>> found;
+        DIR* dir = opendir("/sys/devices/system/node");
+        for (dirent* entry; dir && (entry = readdir(dir));) {
+          int node;
+          char tail;
+          if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1) {
+            continue;
+          }
+          char path[128];
+          snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/"
+              "cpulist", node);
+          cpu_set_t cpus;
+          if (read_cpulist(path, allowed_, cpus) && CPU_COUNT(&cpus) > 0) {
+            found.push_back(std::make_pair(node, cpus));
+          }
+        }
+        if (dir) {
+          closedir(dir);
+        }
+        std::sort(found.begin(), found.end(), [](
+              const std::pair<int, cpu_set_t>& a,
+              const std::pair<int, cpu_set_t>& b) {
+            return a.first < b.first;
+            });
+        for (auto& node : found) {
+          nodes_.push_back(node.second);
+        }
+        if (nodes_.empty()) {
+          nodes_.push_back(allowed_);
+        }
+      }
+
+      /* List looks like 0-3,8-11, only allowed CPUs are kept. */
+      static inline bool read_cpulist(
+          const char* path,
+          const cpu_set_t& allowed,
+          cpu_set_t& cpus
+          ) {
+        FILE* fp = fopen(path, "r");
+        if (!fp) {
+          return false;
+        }
+        CPU_ZERO(&cpus);
+        int lo, hi;
+        while (fscanf(fp, "%d", &lo) == 1) {
+          hi = lo;
+          int sep = fgetc(fp);
+          if (sep == '-') {
+            if (fscanf(fp, "%d", &hi) != 1) {
+              break;
+            }
+            sep = fgetc(fp);
+          }
+          for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+              CPU_SET(cpu, &cpus);
+            }
+          }
+          if (sep != ',') {
+            break;
+          }
+        }
+        fclose(fp);
+        return true;
+      }
+
+    public:
+      static inline const NumaTopology& system() {
+        static const NumaTopology topology;
+        return topology;
+      }
+
+      inline int nodes() const {
+        return nodes_.size();
+      }
+
+      /** Restricts the calling thread to CPUs of given node. */
+      inline bool pin(const int node) const {
+        assert(node < nodes());
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &nodes_[node]) == 0;
+      }
+
+      /** Lets the calling thread run on any CPU of the process again. */
+      inline bool unpin() const {
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &allowed_) == 0;
+      }
+  };
+
+  /** Persistent threads with a deque of tasks each. A thread takes the
+   * newest task of its own deque and steals the oldest ones of others when
+   * it runs out, tasks pushed from outside are spread round-robin. Threads
+   * of a pinned pool run on NUMA nodes round-robin. */
+  class WorkerPool {
+    public:
+      typedef std::function<void()> Task;
+      /* Items per task of data-parallel loops over vertices or edges. */
+      static const int64_t kGrain = 1 << 14;
+
+      /** CPU jobs which keep every hardware thread busy, one of them hosts
+       * the GPU if it is used. */
+      static inline int hardware_jobs(const bool use_gpu) {
+        const int threads = std::max(1u, std::thread::hardware_concurrency());
+        return use_gpu ? threads - 1 : threads;
+      }
+
+      WorkerPool(const int threads, const bool pinned) :
+        kNodes_(pinned ? NumaTopology::system().nodes() : 1),
+        pending_(0),
+        stop_(false),
+        next_(0)
+      {
+        assert(threads > 0);
+        for (int t = 0; t < threads; t++) {
+          queues_.emplace_back(new Queue());
+        }
+        for (int t = 0; t < threads; t++) {
+          threads_.push_back(std::thread(&WorkerPool::work, this, t, pinned));
+        }
+      }
+
+      ~WorkerPool() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+          thread.join();
+        }
+      }
+
+      WorkerPool(const WorkerPool&) = delete;
+      WorkerPool& operator=(const WorkerPool&) = delete;
+
+      inline int size() const {
+        return threads_.size();
+      }
+
+      /** Nodes which threads are spread over, 1 unless pinned. */
+      inline int nodes() const {
+        return kNodes_;
+      }
+
+      /** Node of the calling thread if it belongs to a pinned pool. */
+      static inline int node() {
+        return self().node_;
+      }
+
+      template<typename Function>
+        inline std::future<decltype(std::declval<Function>()())> submit(
+            Function function
+            ) {
+          typedef decltype(function()) Result;
+          auto task = std::make_shared<std::packaged_task<Result()>>(
+              std::move(function));
+          push(home(), [task]() { (*task)(); });
+          return task->get_future();
+        }
+
+      /** Calls function(lo, hi) for chunks of [begin, end) of given size and
+       * waits for all of them. The caller and helper tasks claim chunks of
+       * this loop only, so a waiting caller never runs unrelated tasks. */
+      template<typename Function>
+        inline void parallel_for(
+            const int64_t begin,
+            const int64_t end,
+            const int64_t grain,
+            Function function
+            ) {
+          assert(grain > 0);
+          if (begin >= end) {
+            return;
+          } else if (end - begin <= grain) {
+            function(begin, end);
+            return;
+          }
+          /* Helpers which start late find no chunk left and must not touch
+           * the caller's frame, the group outlives it. */
+          struct Group {
+            Function* function_;
+            int64_t begin_, end_, grain_, chunks_;
+            std::atomic<int64_t> next_;
+            int64_t left_;
+            std::mutex mutex_;
+            std::condition_variable done_;
+            std::exception_ptr error_;
+
+            inline void run() {
+              for (int64_t c; (c = next_++) < chunks_;) {
+                const int64_t lo = begin_ + c * grain_;
+                std::exception_ptr error;
+                try {
+                  (*function_)(lo, std::min(lo + grain_, end_));
+                } catch (...) {
+                  error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (error && !error_) {
+                  error_ = error;
+                }
+                if (--left_ == 0) {
+                  done_.notify_all();
+                }
+              }
+            }
+          };
+          std::shared_ptr<Group> group = std::make_shared<Group>();
+          group->function_ = &function;
+          group->begin_ = begin;
+          group->end_ = end;
+          group->grain_ = grain;
+          group->chunks_ = (end - begin + grain - 1) / grain;
+          group->next_ = 0;
+          group->left_ = group->chunks_;
+          const int first = home() < 0 ? next_++ % size() : home();
+          const int64_t helpers = std::min<int64_t>(group->chunks_ - 1,
+              size());
+          for (int64_t h = 0; h < helpers; h++) {
+            push((first + h) % size(), [group]() { group->run(); });
+          }
+          group->run();
+          {
+            std::unique_lock<std::mutex> lock(group->mutex_);
+            group->done_.wait(lock, [&group]() { return group->left_ == 0; });
+          }
+          if (group->error_) {
+            std::rethrow_exception(group->error_);
+          }
+        }
+
+      /** Replaces every value of [first, last) with the sum of values which
+       * precede it and returns the sum of all of them. */
+      template<typename Iterator>
+        inline typename std::iterator_traits<Iterator>::value_type
+        exclusive_scan(Iterator first, Iterator last) {
+          typedef typename std::iterator_traits<Iterator>::value_type Value;
+          const int64_t count = last - first;
+          std::vector<Value> sums((count + kGrain - 1) / kGrain + 1, 0);
+          parallel_for(0, count, kGrain, [&](int64_t lo, int64_t hi) {
+              Value sum = 0;
+              for (Iterator it = first + lo, itN = first + hi; it != itN;
+                  it++) {
+                sum += *it;
+              }
+              sums[lo / kGrain + 1] = sum;
+              });
+          for (size_t c = 1; c < sums.size(); c++) {
+            sums[c] += sums[c - 1];
+          }
+          parallel_for(0, count, kGrain, [&](int64_t lo, int64_t hi) {
+              Value sum = sums[lo / kGrain];
+              for (Iterator it = first + lo, itN = first + hi; it != itN;
+                  it++) {
+                const Value value = *it;
+                *it = sum;
+                sum += value;
+              }
+              });
+          return sums.back();
+        }
+
+    private:
+      struct Queue {
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+      };
+
+      struct Self {
+        const WorkerPool* pool_;
+        int index_;
+        int node_;
+      };
+
+      const int kNodes_;
+      std::vector<std::unique_ptr<Queue>> queues_;
+      std::vector<std::thread> threads_;
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      /* Raised under mutex_, so that sleeping threads miss no task, taking
+       * a task lowers it under the lock of its deque only. */
+      std::atomic<int64_t> pending_;
+      bool stop_;
+      std::atomic<unsigned> next_;
+
+      static inline Self& self() {
+        static thread_local Self own = { nullptr, -1, 0 };
+        return own;
+      }
+
+      /* Own deque of a thread of this pool, -1 elsewhere. */
+      inline int home() const {
+        return self().pool_ == this ? self().index_ : -1;
+      }
+
+      inline void push(int queue, Task&& task) {
+        if (queue < 0) {
+          queue = next_++ % size();
+        }
+        {
+          std::lock_guard<std::mutex> lock(queues_[queue]->mutex_);
+          queues_[queue]->tasks_.push_back(std::move(task));
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          pending_++;
+        }
+        wake_.notify_one();
+      }
+
+      inline bool take(const int queue, const bool newest, Task& task) {
+        std::lock_guard<std::mutex> lock(queues_[queue]->mutex_);
+        std::deque<Task>& tasks = queues_[queue]->tasks_;
+        if (tasks.empty()) {
+          return false;
+        }
+        if (newest) {
+          task = std::move(tasks.back());
+          tasks.pop_back();
+        } else {
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        pending_--;
+        return true;
+      }
+
+      /* Runs a task of own deque or a stolen one, if there is any, only
+       * pool threads do so. */
+      inline bool run_one(const int own) {
+        Task task;
+        bool found = own >= 0 && take(own, true, task);
+        for (int k = 1, kN = size(); !found && k <= kN; k++) {
+          const int victim = (std::max(own, 0) + k) % kN;
+          found = victim != own && take(victim, false, task);
+        }
+        if (found) {
+          task();
+        }
+        return found;
+      }
+
+      inline void work(const int index, const bool pinned) {
+        self().pool_ = this;
+        self().index_ = index;
+        self().node_ = pinned ? index % kNodes_ : 0;
+        if (pinned && !NumaTopology::system().pin(self().node_)) {
+          MICROPROF_WARN(true, "Cannot pin worker to its node.");
+        }
+        for (;;) {
+          if (run_one(index)) {
+            continue;
+          }
+          std::unique_lock<std::mutex> lock(mutex_);
+          wake_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+          if (stop_) {
+            return;
+          }
+        }
+      }
+  };
+
+}  // namespace brandes
+
+#endif  // BRANDESPOOL_H_
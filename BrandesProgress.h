@@ -0,0 +1,109 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESPROGRESS_H_
+#define BRANDESPROGRESS_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+
+#include "./BrandesCheckpoint.h"
+
+namespace brandes {
+
+  /** Periodically rewrites a status file with progress of a dispatch, the
+   * file is replaced atomically so that readers never see a partial one.
+   * Lines are "key value", workers are listed as "worker slot kind done".
+   * Traversed edges per second count every source as traversing each
+   * undirected edge once. */
+  template<typename Return> class StatusFile {
+    private:
+      const SourceDispatch<Return>& dispatch_;
+      const char* const kPath_;
+      const std::chrono::duration<double> kInterval_;
+      const int64_t kEdges_;
+      const int64_t kTotal_;
+      const MicroBenchClock::time_point kStart_;
+      std::mutex mutex_;
+      std::condition_variable cond_;
+      bool stop_;
+      std::thread writer_;
+
+      void write(const char* state) {
+        const double elapsed = std::chrono::duration<double>(
+            MicroBenchClock::now() - kStart_).count();
+        const int64_t done = dispatch_.done();
+        const double rate = elapsed > 0 ? done / elapsed : 0;
+        const std::string tmp_path = std::string(kPath_) + ".tmp";
+        FILE* fp = fopen(tmp_path.c_str(), "w");
+        if (!fp) {
+          return;
+        }
+        fprintf(fp, "state %s\n", state);
+        fprintf(fp, "sources_done %lld\n", static_cast<long long>(done));
+        fprintf(fp, "sources_total %lld\n", static_cast<long long>(kTotal_));
+        fprintf(fp, "elapsed %.3f\n", elapsed);
+        fprintf(fp, "sources_per_second %.3f\n", rate);
+        fprintf(fp, "teps %.0f\n", rate * kEdges_);
+        if (rate > 0) {
+          fprintf(fp, "eta %.3f\n", (kTotal_ - done) / rate);
+        } else {
+          fprintf(fp, "eta -\n");
+        }
+        const int workers = std::min<int>(dispatch_.workers_,
+            dispatch_.kMaxWorkers);
+        for (int w = 0; w < workers; w++) {
+          const char* kind = dispatch_.kinds_[w];
+          fprintf(fp, "worker %d %s %lld\n", w, kind ? kind : "-",
+              static_cast<long long>(dispatch_.done_by_[w]));
+        }
+        if (fclose(fp) == 0) {
+          std::rename(tmp_path.c_str(), kPath_);
+        }
+      }
+
+      void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cond_.wait_for(lock, kInterval_, [this] { return stop_; })) {
+          write(cancellation() ? "cancelling" : "running");
+        }
+      }
+
+    public:
+      StatusFile(
+          const SourceDispatch<Return>& dispatch,
+          const char* path,
+          double interval,
+          int64_t edges
+          ) :
+        dispatch_(dispatch),
+        kPath_(path),
+        kInterval_(interval),
+        kEdges_(edges),
+        kTotal_(dispatch.total()),
+        kStart_(MicroBenchClock::now()),
+        stop_(false),
+        writer_(&StatusFile::run, this)
+      {}
+
+      ~StatusFile() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        cond_.notify_one();
+        writer_.join();
+        write(cancellation() ? "cancelled" : "done");
+      }
+
+      StatusFile(const StatusFile&) = delete;
+      StatusFile& operator=(const StatusFile&) = delete;
+  };
+
+}  // namespace brandes
+
+#endif  // BRANDESPROGRESS_H_
@@ -0,0 +1,326 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESSIMD_H_
+#define BRANDESSIMD_H_
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#include "./BrandesCommons.h"
+
+/* Kernels for wider instruction sets are compiled with target attributes,
+ * so that the binary runs on any x86-64 CPU and picks them at runtime. */
+#if !defined(NO_SIMD) && defined(__x86_64__) &&\
+  (defined(__clang__) || __GNUC__ >= 5)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+namespace brandes {
+
+  enum SimdLevel { kSimdScalar, kSimdAVX2, kSimdAVX512 };
+
+  /** Widest instruction set of the CPU which kernels below can use,
+   * detected once. */
+  inline SimdLevel simd_supported() {
+#if SIMD_X86
+    static const SimdLevel level = [] {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f") ? kSimdAVX512
+        : __builtin_cpu_supports("avx2") ? kSimdAVX2 : kSimdScalar;
+    }();
+    return level;
+#else
+    return kSimdScalar;
+#endif
+  }
+
+  inline std::atomic<int>& simd_cap() {
+    static std::atomic<int> cap(kSimdAVX512);
+    return cap;
+  }
+
+  /** Instruction set used by kernels, the widest supported one unless
+   * limited. */
+  inline SimdLevel simd_level() {
+    return static_cast<SimdLevel>(std::min<int>(simd_supported(),
+          simd_cap().load(std::memory_order_relaxed)));
+  }
+
+  inline const char* simd_name(const SimdLevel level) {
+    return level == kSimdAVX512 ? "avx512" : level == kSimdAVX2 ? "avx2"
+      : "scalar";
+  }
+
+  /** Limits kernels to the named instruction set (scalar, avx2 or avx512),
+   * returns false if the name is unknown. */
+  inline bool simd_limit(const char* name) {
+    for (int level = kSimdScalar; level <= kSimdAVX512; level++) {
+      if (strcmp(name, simd_name(static_cast<SimdLevel>(level))) == 0) {
+        simd_cap() = level;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Calls visit(w) for every neighbour w in [first, last) such that dist[w]
+   * equals a or b. Levels of whole vectors of neighbours are gathered and
+   * compared at once, dist may change while neighbours are visited, so
+   * visit is expected to check it again. */
+  template<typename VertexId, typename Visit>
+    inline void simd_select(
+        const SimdLevel,
+        const VertexId* first,
+        const VertexId* last,
+        const VertexId* dist,
+        const VertexId a,
+        const VertexId b,
+        Visit visit
+        ) {
+      for (; first != last; first++) {
+        const VertexId d = dist[*first];
+        if (d == a || d == b) {
+          visit(*first);
+        }
+      }
+    }
+
+  /** Sets delta[v] = weight[v] / sigma[v] for v in [0, n). */
+  template<typename Result>
+    inline void simd_divide(
+        const SimdLevel,
+        Result* delta,
+        const Result* weight,
+        const SigmaInt* sigma,
+        const int64_t n
+        ) {
+      for (int64_t v = 0; v < n; v++) {
+        delta[v] = weight[v] / sigma[v];
+      }
+    }
+
+  /** Adds (delta[v] * sigma[v] - 1) * scale to bc[v] for every vertex v in
+   * [0, n) with non-negative dist[v]. */
+  template<typename Value, typename Result, typename VertexId>
+    inline void simd_accumulate(
+        const SimdLevel,
+        Value* bc,
+        const Result* delta,
+        const SigmaInt* sigma,
+        const VertexId* dist,
+        const int64_t n,
+        const Value scale
+        ) {
+      for (int64_t v = 0; v < n; v++) {
+        if (dist[v] >= 0) {
+          bc[v] += (delta[v] * sigma[v] - 1) * scale;
+        }
+      }
+    }
+
+#if SIMD_X86
+  /* Masked forms of AVX-512 intrinsics with every lane set, unmasked ones
+   * start from undefined registers, which GCC warns about. */
+  static const __mmask16 kAll = 0xffff;
+
+  template<typename Visit>
+    __attribute__((target("avx2")))
+    inline const int32_t* simd_select_avx2(
+        const int32_t* first,
+        const int32_t* last,
+        const int32_t* dist,
+        const int32_t a,
+        const int32_t b,
+        Visit& visit
+        ) {
+      const __m256i va = _mm256_set1_epi32(a), vb = _mm256_set1_epi32(b);
+      for (; last - first >= 8; first += 8) {
+        const __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(first));
+        const __m256i d = _mm256_i32gather_epi32(dist, w, 4);
+        unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(
+              _mm256_or_si256(_mm256_cmpeq_epi32(d, va),
+                _mm256_cmpeq_epi32(d, vb))));
+        for (; bits; bits &= bits - 1) {
+          visit(first[__builtin_ctz(bits)]);
+        }
+      }
+      return first;
+    }
+
+  template<typename Visit>
+    __attribute__((target("avx512f")))
+    inline const int32_t* simd_select_avx512(
+        const int32_t* first,
+        const int32_t* last,
+        const int32_t* dist,
+        const int32_t a,
+        const int32_t b,
+        Visit& visit
+        ) {
+      const __m512i va = _mm512_set1_epi32(a), vb = _mm512_set1_epi32(b);
+      for (; last - first >= 16; first += 16) {
+        const __m512i w = _mm512_loadu_si512(first);
+        const __m512i d = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(),
+            kAll, w, dist, 4);
+        unsigned bits = _mm512_cmpeq_epi32_mask(d, va) |
+          _mm512_cmpeq_epi32_mask(d, vb);
+        for (; bits; bits &= bits - 1) {
+          visit(first[__builtin_ctz(bits)]);
+        }
+      }
+      return first;
+    }
+
+  /* Vertex lists shorter than a vector are left to the scalar loop. */
+  template<typename Visit>
+    inline void simd_select(
+        const SimdLevel level,
+        const int32_t* first,
+        const int32_t* last,
+        const int32_t* dist,
+        const int32_t a,
+        const int32_t b,
+        Visit visit
+        ) {
+      if (level == kSimdAVX512) {
+        first = simd_select_avx512(first, last, dist, a, b, visit);
+      } else if (level == kSimdAVX2) {
+        first = simd_select_avx2(first, last, dist, a, b, visit);
+      }
+      for (; first != last; first++) {
+        const int32_t d = dist[*first];
+        if (d == a || d == b) {
+          visit(*first);
+        }
+      }
+    }
+
+  __attribute__((target("avx2")))
+    inline int64_t simd_divide_avx2(
+        float* delta,
+        const float* weight,
+        const SigmaInt* sigma,
+        const int64_t n
+        ) {
+      int64_t v = 0;
+      for (; v + 8 <= n; v += 8) {
+        const __m256 s = _mm256_cvtepi32_ps(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(sigma + v)));
+        _mm256_storeu_ps(delta + v, _mm256_div_ps(_mm256_loadu_ps(weight + v),
+              s));
+      }
+      return v;
+    }
+
+  __attribute__((target("avx512f")))
+    inline int64_t simd_divide_avx512(
+        float* delta,
+        const float* weight,
+        const SigmaInt* sigma,
+        const int64_t n
+        ) {
+      int64_t v = 0;
+      for (; v + 16 <= n; v += 16) {
+        const __m512 s = _mm512_maskz_cvtepi32_ps(kAll,
+            _mm512_loadu_si512(sigma + v));
+        _mm512_storeu_ps(delta + v, _mm512_div_ps(_mm512_loadu_ps(weight + v),
+              s));
+      }
+      return v;
+    }
+
+  inline void simd_divide(
+      const SimdLevel level,
+      float* delta,
+      const float* weight,
+      const SigmaInt* sigma,
+      const int64_t n
+      ) {
+    int64_t v = level == kSimdAVX512 ? simd_divide_avx512(delta, weight,
+        sigma, n) : level == kSimdAVX2 ? simd_divide_avx2(delta, weight,
+          sigma, n) : 0;
+    for (; v < n; v++) {
+      delta[v] = weight[v] / sigma[v];
+    }
+  }
+
+  /* Unvisited vertices are masked out before their (infinite) terms are
+   * added. */
+  __attribute__((target("avx2")))
+    inline int64_t simd_accumulate_avx2(
+        float* bc,
+        const float* delta,
+        const SigmaInt* sigma,
+        const int32_t* dist,
+        const int64_t n,
+        const float scale
+        ) {
+      const __m256 one = _mm256_set1_ps(1.0f), vscale = _mm256_set1_ps(scale);
+      const __m256i none = _mm256_set1_epi32(-1);
+      int64_t v = 0;
+      for (; v + 8 <= n; v += 8) {
+        const __m256 s = _mm256_cvtepi32_ps(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(sigma + v)));
+        const __m256 term = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(
+                _mm256_loadu_ps(delta + v), s), one), vscale);
+        const __m256i visited = _mm256_cmpgt_epi32(_mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(dist + v)), none);
+        _mm256_storeu_ps(bc + v, _mm256_add_ps(_mm256_loadu_ps(bc + v),
+              _mm256_and_ps(term, _mm256_castsi256_ps(visited))));
+      }
+      return v;
+    }
+
+  __attribute__((target("avx512f")))
+    inline int64_t simd_accumulate_avx512(
+        float* bc,
+        const float* delta,
+        const SigmaInt* sigma,
+        const int32_t* dist,
+        const int64_t n,
+        const float scale
+        ) {
+      const __m512 one = _mm512_set1_ps(1.0f), vscale = _mm512_set1_ps(scale);
+      const __m512i none = _mm512_set1_epi32(-1);
+      int64_t v = 0;
+      for (; v + 16 <= n; v += 16) {
+        const __m512 s = _mm512_maskz_cvtepi32_ps(kAll,
+            _mm512_loadu_si512(sigma + v));
+        const __m512 term = _mm512_mul_ps(_mm512_sub_ps(_mm512_mul_ps(
+                _mm512_loadu_ps(delta + v), s), one), vscale);
+        const __mmask16 visited = _mm512_cmpgt_epi32_mask(
+            _mm512_loadu_si512(dist + v), none);
+        const __m512 acc = _mm512_loadu_ps(bc + v);
+        _mm512_storeu_ps(bc + v, _mm512_mask_add_ps(acc, visited, acc, term));
+      }
+      return v;
+    }
+
+  inline void simd_accumulate(
+      const SimdLevel level,
+      float* bc,
+      const float* delta,
+      const SigmaInt* sigma,
+      const int32_t* dist,
+      const int64_t n,
+      const float scale
+      ) {
+    int64_t v = level == kSimdAVX512 ? simd_accumulate_avx512(bc, delta,
+        sigma, dist, n, scale) : level == kSimdAVX2 ? simd_accumulate_avx2(bc,
+          delta, sigma, dist, n, scale) : 0;
+    for (; v < n; v++) {
+      if (dist[v] >= 0) {
+        bc[v] += (delta[v] * sigma[v] - 1) * scale;
+      }
+    }
+  }
+#endif  // SIMD_X86
+
+}  // namespace brandes
+
+#endif  // BRANDESSIMD_H_
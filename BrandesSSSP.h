@@ -0,0 +1,401 @@
+/** @author Mateusz Machalica */
+#ifndef BRANDESSSSP_H_
+#define BRANDESSSSP_H_
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "./BrandesNUMA.h"
+
+namespace brandes {
+
+  /** Bucket width for delta-stepping, defaults to mean edge length. */
+  template<typename LengthList>
+    inline typename LengthList::value_type sssp_delta(
+        Context& ctx,
+        const LengthList __pass__ len
+        ) {
+      typedef typename LengthList::value_type Length;
+      if (ctx.kDelta_ > 0) {
+        return ctx.kDelta_;
+      }
+      double sum = 0.0;
+      for (auto l : len) {
+        sum += l;
+      }
+      return len.empty() ? Length(1) : static_cast<Length>(sum / len.size());
+    }
+
+  template<typename Length> inline Length sssp_unreached() {
+    return std::numeric_limits<Length>::max();
+  }
+
+  /** Whether a path of length a ties with one of length b, sums of the same
+   * lengths taken in a different order may differ in the last bits. Paths
+   * which differ by less than 16 units in the last place relative to b are
+   * counted as equally short. */
+  template<typename Length> inline bool sssp_tied(Length a, Length b) {
+    return std::abs(a - b) <= 16 * std::numeric_limits<Length>::epsilon() * b;
+  }
+
+  /** Half of the shortest length, a predecessor lies at least twice that
+   * much closer to the source than its successor. */
+  template<typename LengthList>
+    inline typename LengthList::value_type sssp_half(
+        const LengthList __pass__ len
+        ) {
+      typedef typename LengthList::value_type Length;
+      return len.empty() ? Length(1)
+        : *std::min_element(len.begin(), len.end()) / 2;
+    }
+
+  /** Whether a vertex at distance du precedes one at dw over an edge of
+   * length l. Without the distance checks an edge much shorter than the
+   * distances would tie with itself taken back and forth. */
+  template<typename Length>
+    inline bool sssp_precedes(Length du, Length l, Length dw, Length half) {
+      return du < dw && du <= dw - half && sssp_tied(du + l, dw);
+    }
+
+  /** Lowers *addr to value, returns true if value was stored. */
+  template<typename Length>
+    inline bool atomic_fetch_min(Length* addr, Length value) {
+      Length old;
+      __atomic_load(addr, &old, __ATOMIC_RELAXED);
+      while (value < old) {
+        if (__atomic_compare_exchange(addr, &old, &value, true,
+              __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+  /** Dependency accumulation of the Dijkstra worker, order holds all
+   * reached vertices sorted by non-decreasing distance and sigma is already
+   * complete for them. */
+  template<typename Return, typename VertexList, typename LengthList,
+    typename SigmaList, typename VertexIterator>
+    static inline void sssp_accumulate(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const LengthList __pass__ len,
+        const Return __pass__ weight,
+        const LengthList __pass__ dist,
+        const SigmaList __pass__ sigma,
+        Return __pass__ delta,
+        VertexIterator ofront,
+        VertexIterator oback,
+        const typename LengthList::value_type half
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef typename LengthList::value_type Length;
+      for (auto it = ofront; it != oback; it++) {
+        delta[*it] = weight[*it] / sigma[*it];
+      }
+      while (oback != ofront) {
+        VertexId w = *--oback;
+        const Length dw = dist[w];
+        for (VertexId i = ptr[w], iN = ptr[w + 1]; i < iN; i++) {
+          VertexId v = adj[i];
+          if (sssp_precedes(dist[v], len[i], dw, half)) {
+            delta[v] += delta[w];
+          }
+        }
+      }
+    }
+
+  template<typename Return, typename VertexList, typename LengthList>
+    static inline Return bc_cpu_dijkstra_worker(
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const LengthList __pass__ len,
+        const Return __pass__ weight,
+        SourceDispatch<Return>* source_dispatch
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef typename LengthList::value_type Length;
+      typedef std::pair<Length, VertexId> HeapEntry;
+      const VertexId n = ptr.size() - 1;
+      const Length kUnreached = sssp_unreached<Length>();
+      const Length kHalf = sssp_half(len);
+      Return bc(n, 0.0f), delta(n);
+      VertexList order(n);
+      LengthList dist(n);
+      HugeVector<SigmaInt> sigma(n);
+      std::vector<HeapEntry> heap;
+      std::greater<HeapEntry> heap_cmp;
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("cpu");
+      /* Only vertices reached from a source are reset after it. */
+      std::fill(dist.begin(), dist.end(), kUnreached);
+      std::fill(sigma.begin(), sigma.end(), 0);
+      while ((source = source_dispatch->fetch()) < n) {
+        auto oback = order.begin();
+        /* Init source. */
+        dist[source] = 0;
+        sigma[source] = 1;
+        heap.push_back(HeapEntry(0, source));
+        /* Forward. */
+        while (!heap.empty()) {
+          std::pop_heap(heap.begin(), heap.end(), heap_cmp);
+          const HeapEntry top = heap.back();
+          heap.pop_back();
+          VertexId v = top.second;
+          if (top.first > dist[v]) {
+            continue;
+          }
+          *oback++ = v;
+          for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+            VertexId w = adj[i];
+            const Length dw = dist[v] + len[i];
+            if (sssp_precedes(dist[v], len[i], dist[w], kHalf)) {
+              sigma[w] += sigma[v];
+              assert(sigma[w] >= 0);
+            } else if (dw < dist[w]) {
+              dist[w] = dw;
+              sigma[w] = sigma[v];
+              heap.push_back(HeapEntry(dw, w));
+              std::push_heap(heap.begin(), heap.end(), heap_cmp);
+            }
+          }
+        }
+        /* Intermediate and backward. */
+        sssp_accumulate(ptr, adj, len, weight, dist, sigma, delta,
+            order.begin(), oback, kHalf);
+        /* Sum and reset reached vertices. */
+        for (auto it = order.begin(); it != oback; it++) {
+          VertexId v = *it;
+          if (v != source) {
+            bc[v] += (delta[v] * sigma[v] - 1) * weight[source];
+          }
+          dist[v] = kUnreached;
+          sigma[v] = 0;
+        }
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_WORKER:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
+  /** Parallel delta-stepping, threads of the pool work on the same source
+   * which keeps memory footprint independent of their number. Each phase
+   * relaxes edges of the frontier of the current bucket in parallel, vertices
+   * whose distance dropped are put into buckets of their new distance, the
+   * bucket is done once a phase puts nothing back into it. Vertices are
+   * recorded in the order of buckets they settle in and sorted by distance
+   * within buckets, those closer than half of the shortest edge length form
+   * a level, so that neither path counts nor dependencies flow between
+   * vertices of a level and each vertex pulls them from its neighbours. */
+  template<typename Return, typename VertexList, typename LengthList>
+    static inline Return bc_cpu_delta_team(
+        WorkerPool* pool,
+        const VertexList __pass__ ptr,
+        const VertexList __pass__ adj,
+        const LengthList __pass__ len,
+        const Return __pass__ weight,
+        SourceDispatch<Return>* source_dispatch,
+        const typename LengthList::value_type sssp_delta
+        ) {
+      typedef typename VertexList::value_type VertexId;
+      typedef typename LengthList::value_type Length;
+      typedef typename Return::value_type Result;
+      const VertexId n = ptr.size() - 1;
+      const Length kUnreached = sssp_unreached<Length>();
+      const Length kHalf = sssp_half(len);
+      const int64_t kGrain = 1 << 10;
+      assert(sssp_delta > 0);
+      Return bc(n, 0.0f), delta(n);
+      LengthList dist(n, kUnreached);
+      HugeVector<SigmaInt> sigma(n, 0);
+      std::vector<char> settled(n, 0);
+      /* Vertex may be put into buckets more than once, but every time is paid
+       * by a successful relaxation of a distinct edge. Relaxations from the
+       * current bucket reach no further than the longest edge, so buckets
+       * are kept in a cyclic array of that many slots and memory does not
+       * grow with distances. */
+      const size_t kSpan = static_cast<size_t>((len.empty() ? Length(0)
+            : *std::max_element(len.begin(), len.end())) / sssp_delta) + 3;
+      std::vector<VertexList> bins(kSpan);
+      size_t last_bin;
+      std::mutex bins_mutex;
+      VertexList order(n), frontier;
+      std::atomic<VertexId> tail;
+      /* Bucket b settled order[buckets[b]] .. order[buckets[b + 1] - 1], level
+       * l spans order[levels[l]] .. order[levels[l + 1] - 1]. */
+      std::vector<VertexId> buckets, levels;
+      std::vector<std::vector<VertexId>> starts;
+      VertexList finished;
+      VertexId source, processed_count = 0;
+      MICROPROF_START(cpu_worker);
+      SourceBatchTrace trace(adj.size());
+      const int slot = source_dispatch->enroll("team");
+      while ((source = source_dispatch->fetch()) < n) {
+        /* Init source. */
+        dist[source] = 0;
+        sigma[source] = 1;
+        bins[0].assign(1, source);
+        last_bin = 0;
+        buckets.clear();
+        tail = 0;
+        /* Forward. */
+        for (size_t bin = 0; bin <= last_bin; bin++) {
+          VertexList& current = bins[bin % kSpan];
+          if (!current.empty()) {
+            buckets.push_back(tail);
+          }
+          while (!current.empty()) {
+            frontier.swap(current);
+            current.clear();
+            pool->parallel_for(0, frontier.size(), kGrain,
+                [&](int64_t lo, int64_t hi) {
+                /* Buckets from the current one on. */
+                std::vector<VertexList> found;
+                VertexList reached;
+                for (int64_t fi = lo; fi < hi; fi++) {
+                  const VertexId v = frontier[fi];
+                  Length dv;
+                  __atomic_load(&dist[v], &dv, __ATOMIC_RELAXED);
+                  /* Settled in an earlier bucket meanwhile, bucket of the
+                   * distance is rounded the same way as when it was put. */
+                  if (static_cast<size_t>(dv / sssp_delta) < bin) {
+                    continue;
+                  }
+                  if (!__atomic_exchange_n(&settled[v], 1, __ATOMIC_RELAXED)) {
+                    reached.push_back(v);
+                  }
+                  for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+                    const VertexId w = adj[i];
+                    const Length dw = dv + len[i];
+                    if (atomic_fetch_min(&dist[w], dw)) {
+                      const size_t at = std::max(
+                          static_cast<size_t>(dw / sssp_delta), bin) - bin;
+                      assert(at < kSpan);
+                      if (at >= found.size()) {
+                        found.resize(at + 1);
+                      }
+                      found[at].push_back(w);
+                    }
+                  }
+                }
+                const VertexId to = tail.fetch_add(reached.size());
+                std::copy(reached.begin(), reached.end(), order.begin() + to);
+                std::lock_guard<std::mutex> lock(bins_mutex);
+                for (size_t at = 0; at < found.size(); at++) {
+                  if (!found[at].empty()) {
+                    VertexList& target = bins[(bin + at) % kSpan];
+                    target.insert(target.end(), found[at].begin(),
+                        found[at].end());
+                    last_bin = std::max(last_bin, bin + at);
+                  }
+                }
+                });
+          }
+        }
+        buckets.push_back(tail);
+        /* Distances are final, buckets are sorted and split into levels. */
+        const int64_t bucket_count = buckets.size() - 1;
+        starts.resize(bucket_count);
+        /* About kGrain vertices per task. */
+        const int64_t bucket_grain = std::max<int64_t>(1,
+            bucket_count * kGrain / std::max<int64_t>(tail, 1));
+        pool->parallel_for(0, bucket_count, bucket_grain,
+            [&](int64_t lo, int64_t hi) {
+            for (int64_t b = lo; b < hi; b++) {
+              auto first = order.begin() + buckets[b],
+                   last = order.begin() + buckets[b + 1];
+              std::sort(first, last, [&dist](VertexId x, VertexId y) {
+                  return dist[x] < dist[y];
+                  });
+              starts[b].clear();
+              for (auto it = first; it != last; it++) {
+                if (it == first ||
+                    dist[*it] - dist[order[starts[b].back()]] >= kHalf) {
+                  starts[b].push_back(it - order.begin());
+                }
+              }
+            }
+            });
+        levels.clear();
+        for (int64_t b = 0; b < bucket_count; b++) {
+          levels.insert(levels.end(), starts[b].begin(), starts[b].end());
+        }
+        levels.push_back(tail);
+        assert(order[0] == source && levels[1] == 1);
+        /* Path counts, the source alone is the first level. */
+        for (size_t l = 1; l + 1 < levels.size(); l++) {
+          pool->parallel_for(levels[l], levels[l + 1], kGrain,
+              [&](int64_t lo, int64_t hi) {
+              for (int64_t k = lo; k < hi; k++) {
+                const VertexId w = order[k];
+                const Length dw = dist[w];
+                SigmaInt paths = 0;
+                for (VertexId i = ptr[w], iN = ptr[w + 1]; i < iN; i++) {
+                  if (sssp_precedes(dist[adj[i]], len[i], dw, kHalf)) {
+                    paths += sigma[adj[i]];
+                  }
+                }
+                assert(paths > 0);
+                sigma[w] = paths;
+              }
+              });
+        }
+        /* Intermediate and backward. */
+        for (size_t l = levels.size() - 1; l-- > 0;) {
+          pool->parallel_for(levels[l], levels[l + 1], kGrain,
+              [&](int64_t lo, int64_t hi) {
+              for (int64_t k = lo; k < hi; k++) {
+                const VertexId v = order[k];
+                const Length dv = dist[v];
+                Result dependency = weight[v] / sigma[v];
+                for (VertexId i = ptr[v], iN = ptr[v + 1]; i < iN; i++) {
+                  if (sssp_precedes(dv, len[i], dist[adj[i]], kHalf)) {
+                    dependency += delta[adj[i]];
+                  }
+                }
+                delta[v] = dependency;
+              }
+              });
+        }
+        /* Sum and cleanup of reached vertices. */
+        const Result scale = weight[source];
+        pool->parallel_for(0, tail, kGrain, [&](int64_t lo, int64_t hi) {
+            for (int64_t k = lo; k < hi; k++) {
+              const VertexId v = order[k];
+              if (v != source) {
+                bc[v] += (delta[v] * sigma[v] - 1) * scale;
+              }
+              dist[v] = kUnreached;
+              sigma[v] = 0;
+              settled[v] = 0;
+            }
+            });
+        source_dispatch->finished(slot, source, bc, finished);
+        processed_count++;
+        trace.step();
+        source_dispatch->progress(slot);
+      }
+      source_dispatch->deposit(slot, bc, finished);
+      MICROPROF_END(cpu_worker);
+      MICROPROF_INFO("CPU_TEAM:\tsources processed:\t%d\n", processed_count);
+      return bc;
+    }
+
+}  // namespace brandes
+
+#endif  // BRANDESSSSP_H_
@@ -14,15 +14,13 @@
 namespace brandes {
 
   template<typename Cont> struct statistics {
-    template<typename Return, typename VertexList>
-      inline Return cont(
+    template<typename VertexList>
+      static inline void report(
           Context& ctx,
-          VertexList __pass__ ptr,
-          VertexList __pass__ adj,
-          VertexList __pass__ ccs
-          ) const {
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ ccs
+          ) {
         typedef typename VertexList::value_type VertexId;
-        MICROPROF_START(statistics);
         VertexId lastc = 0, maxcs = 0;
         for (auto c : ccs) {
           maxcs = std::max(c - lastc, maxcs);
@@ -47,9 +45,38 @@ namespace brandes {
             ccs.back(), static_cast<float>(low_count) / ccs.back());
         PRINT_STATS("degree > %d count\t%d / %d = %f\n", big_thr, big_count,
             ccs.back(), static_cast<float>(big_count) / ccs.back());
+      }
+
+    template<typename Return, typename VertexList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          VertexList __pass__ ccs
+          ) const {
+        MICROPROF_START(statistics);
+        report(ctx, ptr, ccs);
         MICROPROF_END(statistics);
         return CONT_BIND(ctx, ptr, adj, ccs);
       }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len,
+          VertexList __pass__ ccs
+          ) const {
+        MICROPROF_START(statistics);
+        report(ctx, ptr, ccs);
+        assert(!len.empty());
+        auto mm = std::minmax_element(len.begin(), len.end());
+        PRINT_STATS("edge length range\t%f .. %f\n",
+            static_cast<double>(*mm.first), static_cast<double>(*mm.second));
+        MICROPROF_END(statistics);
+        return CONT_BIND(ctx, ptr, adj, len, ccs);
+      }
   };
 
   template<typename Cont> struct no_stats {
@@ -62,6 +89,17 @@ namespace brandes {
           ) const {
         return CONT_BIND(ctx, ptr, adj, ccs);
       }
+
+    template<typename Return, typename VertexList, typename LengthList>
+      inline Return cont(
+          Context& ctx,
+          VertexList __pass__ ptr,
+          VertexList __pass__ adj,
+          LengthList __pass__ len,
+          VertexList __pass__ ccs
+          ) const {
+        return CONT_BIND(ctx, ptr, adj, len, ccs);
+      }
   };
 
 }  // namespace brandes
@@ -3,7 +3,9 @@
 #define BRANDESVCSR_H_
 
 #include <cassert>
+#include <cstdint>
 #include <vector>
+#include <algorithm>
 
 #include "./BrandesCPU.h"
 
@@ -14,45 +16,47 @@ namespace brandes {
   }
 
   template<typename Cont> struct vcsr_create {
-    template<typename Return, typename VertexList, typename Dispatch>
-      inline Return cont(
+    template<typename VertexList>
+      static inline void virtualize(
           Context& ctx,
           const VertexList __pass__ ptr,
-          const VertexList __pass__ adj,
-          const Return __pass__ weight,
-          Dispatch& dispatch
-          ) const {
+          VertexList __pass__ vmap,
+          VertexList __pass__ voff
+          ) {
         typedef typename VertexList::value_type VertexId;
         MICROPROF_INFO("CONFIGURATION:\tvirtualized deg\t%d\n",
             1 << ctx.kMDegLog2_);
         MICROPROF_START(virtualization);
-        const size_t kN1Estimate = ptr.size() + (adj.size() >> ctx.kMDegLog2_)
-          + 10;
+        MICROMEM_BEGIN(virtualization);
         const VertexId n = ptr.size() - 1;
-        VertexList vmap, voff;
-        vmap.reserve(kN1Estimate);
-        voff.reserve(kN1Estimate);
-        for (VertexId ind = 0; ind < n; ind++) {
-          VertexId deg = ptr[ind + 1] - ptr[ind],
-                   vcnt = divide_up(deg, ctx.kMDegLog2_);
-          if (vcnt == 0) {
-            vmap.push_back(ind);
-            voff.push_back(0);
-          } else {
-            for (VertexId off = 0; off < vcnt; off++) {
-              vmap.push_back(ind);
-              voff.push_back(off);
+        /* First virtual vertex of every vertex, each one has at least one. */
+        VertexList first(n + 1);
+        ctx.pool().parallel_for(0, n, WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId ind = lo; ind < hi; ind++) {
+              first[ind] = std::max<VertexId>(1,
+                  divide_up(ptr[ind + 1] - ptr[ind], ctx.kMDegLog2_));
             }
-          }
-        }
-        vmap.push_back(n);
-        voff.push_back(0);
-        MICROPROF_WARN(kN1Estimate < vmap.capacity() || kN1Estimate <
-            voff.capacity(), "virtual vertex count estimate too small");
+            });
+        first[n] = 0;
+        const VertexId n1 = ctx.pool().exclusive_scan(first.begin(),
+            first.end());
+        vmap.resize(n1 + 1);
+        voff.resize(n1 + 1);
+        ctx.pool().parallel_for(0, n, WorkerPool::kGrain,
+            [&](int64_t lo, int64_t hi) {
+            for (VertexId ind = lo; ind < hi; ind++) {
+              for (VertexId vind = first[ind]; vind < first[ind + 1]; vind++) {
+                vmap[vind] = ind;
+                voff[vind] = vind - first[ind];
+              }
+            }
+            });
+        vmap[n1] = n;
+        voff[n1] = 0;
 #ifndef NDEBUG
         assert(vmap.size() == voff.size());
         assert(vmap.back() == n);
-        const VertexId n1 = vmap.size() - 1;
         for (VertexId vind = 0; vind < n1; vind++) {
           assert(vmap[vind + 1] >= vmap[vind]);
           assert(vmap[vind + 1] <= vmap[vind] + 1);
@@ -69,9 +73,37 @@ namespace brandes {
           }
         }
 #endif  // NDEBUG
+        MICROMEM_END(virtualization);
         MICROPROF_END(virtualization);
+      }
+
+    template<typename Return, typename VertexList, typename Dispatch>
+      inline Return cont(
+          Context& ctx,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const Return __pass__ weight,
+          Dispatch& dispatch
+          ) const {
+        VertexList vmap, voff;
+        virtualize(ctx, ptr, vmap, voff);
         return CONT_BIND(ctx, vmap, voff, ptr, adj, weight, dispatch);
       }
+
+    template<typename Return, typename VertexList, typename LengthList,
+      typename Dispatch>
+      inline Return cont(
+          Context& ctx,
+          const VertexList __pass__ ptr,
+          const VertexList __pass__ adj,
+          const LengthList __pass__ len,
+          const Return __pass__ weight,
+          Dispatch& dispatch
+          ) const {
+        VertexList vmap, voff;
+        virtualize(ctx, ptr, vmap, voff);
+        return CONT_BIND(ctx, vmap, voff, ptr, adj, len, weight, dispatch);
+      }
   };
 
 }  // namespace brandes
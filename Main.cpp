@@ -34,14 +34,39 @@
 #define DEFAULT_WGROUP 192
 #endif
 
+/* Negative means one job per hardware thread, GPU host thread included. */
 #ifndef DEFAULT_CPU_JOBS
-#define DEFAULT_CPU_JOBS 3
+#define DEFAULT_CPU_JOBS -1
 #endif
 
 #ifndef DEFAULT_USE_GPU
 #define DEFAULT_USE_GPU true
 #endif
 
+#ifndef DEFAULT_DELTA
+#define DEFAULT_DELTA 0
+#endif
+
+#ifndef DEFAULT_TEAM_MIN_N
+#define DEFAULT_TEAM_MIN_N (1 << 20)
+#endif
+
+#ifndef DEFAULT_NUMA
+#define DEFAULT_NUMA true
+#endif
+
+#ifndef DEFAULT_LOW_MEMORY
+#define DEFAULT_LOW_MEMORY false
+#endif
+
+#ifndef DEFAULT_CHECKPOINT_INTERVAL
+#define DEFAULT_CHECKPOINT_INTERVAL 600
+#endif
+
+#ifndef DEFAULT_STATUS_INTERVAL
+#define DEFAULT_STATUS_INTERVAL 1
+#endif
+
 #if   !defined(NO_DEG1) && defined(NO_BFS)
 #error Illegal combination, DEG1 reduction requires BFS ordering.
 #endif
@@ -64,13 +89,26 @@
 #define ALGORITHM_STATS no_stats
 #endif
 
+#ifndef WEIGHTED
+#define ALGORITHM_EDGE Edge
+#define ALGORITHM_CSR csr_create
+#else
+#define ALGORITHM_EDGE WeightedEdge
+#define ALGORITHM_CSR wcsr_create
+#endif
+
 #define ALGORITHM_PIPE\
-  csr_create<ALGORITHM_ORDER<ALGORITHM_STATS<ALGORITHM_DEG1<cpu_driver<vcsr_create<betweenness>>>>>>  // NOLINT(whitespace/line_length)
+  ALGORITHM_CSR<ALGORITHM_ORDER<ALGORITHM_STATS<ALGORITHM_DEG1<cpu_driver<vcsr_create<betweenness>>>>>>  // NOLINT(whitespace/line_length)
 #pragma message "Final algorithm pipe: " BOOST_PP_STRINGIZE(ALGORITHM_PIPE)
 
+#define ALGORITHM_TOPK_PIPE\
+  ALGORITHM_CSR<ALGORITHM_ORDER<ALGORITHM_STATS<kadabra_topk>>>
+
 #include <boost/lexical_cast.hpp>
 
+#include <csignal>
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <cassert>
 #include <utility>
@@ -78,18 +116,62 @@
 #include <future>
 #include <vector>
 
-#include "./BrandesBetweenness.h"
+#include "./BrandesBatch.h"
+
+/* The first signal stops dispatching sources, the second one kills. */
+static void cancel_run(int sig) {
+  brandes::cancellation() = true;
+  signal(sig, SIG_DFL);
+}
 
-template<typename Result>
-static inline void generic_write(Result& res, const char* file_path) {
-  MICROPROF_START(writing_results);
-  FILE* fp = fopen(file_path, "w");
-  assert(fp);
-  for (auto v : res) {
-    fprintf(fp, "%f\n", v);
+/* An empty list would stand for all vertices, so it is an error here. */
+static std::vector<int> read_vertices(const char* file_path) {
+  std::vector<int> ids;
+  FILE* fp = fopen(file_path, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot read %s\n", file_path);
+    exit(1);
   }
+  int v;
+  bool complete = true;
+  while (fscanf(fp, "%d", &v) == 1) {
+    complete &= v >= 0;
+    ids.push_back(v);
+  }
+  /* Skips trailing whitespace, anything else is not an id. */
+  SUPPRESS_UNUSED(fscanf(fp, " "));
+  complete &= feof(fp) != 0;
   fclose(fp);
-  MICROPROF_END(writing_results);
+  if (!complete || ids.empty()) {
+    fprintf(stderr, "Cannot read %s: expected a non-empty list of vertex "
+        "ids\n", file_path);
+    exit(1);
+  }
+  return ids;
+}
+
+static unsigned parse_metrics(const char* names) {
+  unsigned requested = 0;
+  std::string list(names);
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = std::min(list.find(',', start), list.size());
+    const std::string name = list.substr(start, end - start);
+    if (name == "closeness") {
+      requested |= brandes::Metrics::kCloseness;
+    } else if (name == "harmonic") {
+      requested |= brandes::Metrics::kHarmonic;
+    } else if (name == "stress") {
+      requested |= brandes::Metrics::kStress;
+    } else if (name == "edge") {
+      requested |= brandes::Metrics::kEdge;
+    } else if (!name.empty()) {
+      fprintf(stderr, "Unknown metric %s.\n", name.c_str());
+      exit(1);
+    }
+    start = end + 1;
+  }
+  return requested;
 }
 
 static void version() {
@@ -99,12 +181,26 @@ static void version() {
       "DEFAULT_WGROUP=%d\n"
       "DEFAULT_CPU_JOBS=%d\n"
       "DEFAULT_USE_GPU=%d\n"
+      "DEFAULT_DELTA=%f\n"
+      "DEFAULT_TEAM_MIN_N=%d\n"
+      "DEFAULT_NUMA=%d\n"
+      "DEFAULT_LOW_MEMORY=%d\n"
+      "DEFAULT_CHECKPOINT_INTERVAL=%f\n"
+      "DEFAULT_STATUS_INTERVAL=%f\n"
+      "ALGORITHM_EDGE=%s\n"
       "ALGORITHM_PIPE=%s\n",
       OPTIMIZE,
       DEFAULT_MDEG,
       DEFAULT_WGROUP,
       DEFAULT_CPU_JOBS,
       DEFAULT_USE_GPU,
+      static_cast<double>(DEFAULT_DELTA),
+      DEFAULT_TEAM_MIN_N,
+      DEFAULT_NUMA,
+      DEFAULT_LOW_MEMORY,
+      static_cast<double>(DEFAULT_CHECKPOINT_INTERVAL),
+      static_cast<double>(DEFAULT_STATUS_INTERVAL),
+      BOOST_PP_STRINGIZE(ALGORITHM_EDGE),
       BOOST_PP_STRINGIZE(ALGORITHM_PIPE));
   exit(0);
 }
@@ -116,7 +212,17 @@ int main(int argc, const char* argv[]) {
 
   using boost::lexical_cast;
   using namespace brandes;  // NOLINT(build/namespaces)
+  if (getenv("BRANDES_TRACE")) {
+    MicroTrace::enable();
+  }
+  if (getenv("BRANDES_PERF")) {
+    MicroPerf::enable();
+  }
+  if (getenv("BRANDES_MEMORY")) {
+    MicroMemory::enable();
+  }
   MICROPROF_START(main_total);
+  MICROMEM_BEGIN(main_total);
   assert(argc > 2); SUPPRESS_UNUSED(argc);
 
   Context ctx(
@@ -124,18 +230,144 @@ int main(int argc, const char* argv[]) {
       argc > 3 ? lexical_cast<int>(argv[3]) : DEFAULT_MDEG,
       argc > 4 ? lexical_cast<int>(argv[4]) : DEFAULT_WGROUP,
       argc > 5 ? lexical_cast<int>(argv[5]) : DEFAULT_CPU_JOBS,
-      argc > 6 ? lexical_cast<bool>(argv[6]) : DEFAULT_USE_GPU);
+      argc > 6 ? lexical_cast<bool>(argv[6]) : DEFAULT_USE_GPU,
+      DEFAULT_DELTA,
+      DEFAULT_TEAM_MIN_N);
+  ctx.numa_ = getenv("BRANDES_NUMA")
+    ? lexical_cast<bool>(getenv("BRANDES_NUMA")) : DEFAULT_NUMA;
+  ctx.input_format_ = getenv("BRANDES_FORMAT");
+  if (getenv("BRANDES_SIMD") && !simd_limit(getenv("BRANDES_SIMD"))) {
+    fprintf(stderr, "BRANDES_SIMD must be one of scalar, avx2, avx512.\n");
+    return 1;
+  }
+  ctx.low_memory_ = getenv("BRANDES_LOW_MEMORY")
+    ? lexical_cast<bool>(getenv("BRANDES_LOW_MEMORY")) : DEFAULT_LOW_MEMORY;
+  if (getenv("BRANDES_STATE_BUDGET")) {
+    ctx.state_budget_ = lexical_cast<int64_t>(getenv("BRANDES_STATE_BUDGET"));
+  }
+  ctx.checkpoint_path_ = getenv("BRANDES_CHECKPOINT");
+  ctx.checkpoint_interval_ = getenv("BRANDES_CHECKPOINT_INTERVAL")
+    ? lexical_cast<double>(getenv("BRANDES_CHECKPOINT_INTERVAL"))
+    : DEFAULT_CHECKPOINT_INTERVAL;
+  ctx.status_path_ = getenv("BRANDES_STATUS");
+  ctx.status_interval_ = getenv("BRANDES_STATUS_INTERVAL")
+    ? lexical_cast<double>(getenv("BRANDES_STATUS_INTERVAL"))
+    : DEFAULT_STATUS_INTERVAL;
+  if (getenv("BRANDES_PARTITION")) {
+    if (sscanf(getenv("BRANDES_PARTITION"), "%d/%d", &ctx.rank_, &ctx.ranks_)
+        != 2 || ctx.rank_ < 0 || ctx.rank_ >= ctx.ranks_) {
+      fprintf(stderr, "BRANDES_PARTITION must be given as rank/ranks.\n");
+      return 1;
+    }
+    ctx.coordinator_ = getenv("BRANDES_COORDINATOR");
+    if (ctx.ranks_ > 1 && !ctx.coordinator_) {
+      fprintf(stderr, "BRANDES_COORDINATOR must be set for partitioned run.\n");
+      return 1;
+    }
+  }
+  if (getenv("BRANDES_GROUP")) {
+    ctx.sources_ = ctx.targets_ = read_vertices(getenv("BRANDES_GROUP"));
+  }
+  if (getenv("BRANDES_SOURCES")) {
+    ctx.sources_ = read_vertices(getenv("BRANDES_SOURCES"));
+  }
+  if (getenv("BRANDES_TARGETS")) {
+    ctx.targets_ = read_vertices(getenv("BRANDES_TARGETS"));
+  }
+  const unsigned metrics = getenv("BRANDES_METRICS")
+    ? parse_metrics(getenv("BRANDES_METRICS")) : 0;
+#ifdef WEIGHTED
+  if (!ctx.targets_.empty()) {
+    fprintf(stderr, "Restricted targets require unweighted build.\n");
+    return 1;
+  }
+  if (metrics) {
+    fprintf(stderr, "Additional metrics require unweighted build.\n");
+    return 1;
+  }
+#endif
+  if (metrics && !ctx.targets_.empty()) {
+    fprintf(stderr, "Additional metrics cannot be restricted to targets.\n");
+    return 1;
+  }
+  if (getenv("BRANDES_TOPK")) {
+    ctx.topk_ = lexical_cast<int>(getenv("BRANDES_TOPK"));
+    if (getenv("BRANDES_TOPK_DELTA")) {
+      ctx.topk_delta_ = lexical_cast<double>(getenv("BRANDES_TOPK_DELTA"));
+    }
+    if (getenv("BRANDES_TOPK_LAMBDA")) {
+      ctx.topk_lambda_ = lexical_cast<double>(getenv("BRANDES_TOPK_LAMBDA"));
+    }
+  }
+  if ((ctx.topk_ > 0 || getenv("BRANDES_SOCKET") || getenv("BRANDES_UPDATES"))
+      && (ctx.restricted() || metrics)) {
+    fprintf(stderr, "Top-k, daemon and incremental modes cannot be combined "
+        "with restricted betweenness or metrics.\n");
+    return 1;
+  }
 #ifdef MYCL_ERROR_CHECKING
   try {
 #endif
-    auto res = generic_read<ALGORITHM_PIPE>(ctx, argv[1]);
-    generic_write(res, argv[2]);
+    if (ctx.topk_ > 0) {
+#if !defined(WEIGHTED) && !defined(NO_BFS)
+      auto res = generic_read<ALGORITHM_TOPK_PIPE>(ctx, argv[1]);
+      const std::string top_mode = "top:" + std::to_string(ctx.topk_);
+      generic_write(ctx, res, argv[2], getenv("BRANDES_OUTPUT")
+          ? getenv("BRANDES_OUTPUT") : top_mode.c_str());
+#else
+      fprintf(stderr, "Top-k sampling requires unweighted build with BFS.\n");
+      return 1;
+#endif
+    } else if (getenv("BRANDES_SOCKET")) {
+#ifndef WEIGHTED
+      auto res = daemon_read<ALGORITHM_PIPE>(ctx, argv[1],
+          getenv("BRANDES_SOCKET"));
+      generic_write(ctx, res, argv[2], getenv("BRANDES_OUTPUT"));
+#else
+      fprintf(stderr, "Daemon mode requires unweighted build.\n");
+      return 1;
+#endif
+    } else if (getenv("BRANDES_UPDATES")) {
+#ifndef WEIGHTED
+      auto res = incremental_read<ALGORITHM_PIPE>(ctx, argv[1],
+          getenv("BRANDES_BASE"), getenv("BRANDES_UPDATES"));
+      generic_write(ctx, res, argv[2], getenv("BRANDES_OUTPUT"));
+#else
+      fprintf(stderr, "Incremental updates require unweighted build.\n");
+      return 1;
+#endif
+    } else if (getenv("BRANDES_BATCH")) {
+      if (ctx.restricted() || metrics || ctx.checkpoint_path_) {
+        fprintf(stderr, "Batch mode cannot be combined with restricted "
+            "betweenness, metrics or checkpoints.\n");
+        return 1;
+      }
+      batch_run<ALGORITHM_PIPE, std::vector<float>, ALGORITHM_EDGE>(ctx,
+          argv[1], argv[2], getenv("BRANDES_OUTPUT"),
+          lexical_cast<int64_t>(getenv("BRANDES_BATCH")));
+    } else {
+      signal(SIGINT, cancel_run);
+      signal(SIGTERM, cancel_run);
+      ctx.metrics_.requested_ = metrics;
+      auto res = generic_read<ALGORITHM_PIPE, std::vector<float>,
+           ALGORITHM_EDGE>(ctx, argv[1]);
+      generic_write(ctx, res, argv[2], getenv("BRANDES_OUTPUT"));
+      write_metrics(ctx, argv[2]);
+    }
 #ifdef MYCL_ERROR_CHECKING
   } catch (cl::Error error) {
     fprintf(MYCL_STREAM, "%s (error code: %d)\n", error.what(), error.err());
   }
 #endif
 
+  MICROMEM_END(main_total);
   MICROPROF_END(main_total);
-  return 0;
+  if (cancellation()) {
+    fprintf(stderr, "Cancelled, partial results written.\n");
+  }
+  if (getenv("BRANDES_TRACE") && !MicroTrace::dump(getenv("BRANDES_TRACE"))) {
+    fprintf(stderr, "Cannot write trace to %s.\n", getenv("BRANDES_TRACE"));
+    return 1;
+  }
+  return cancellation() ? 2 : 0;
 }
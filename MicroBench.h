@@ -5,7 +5,11 @@
 #include <cstdio>
 #include <chrono>
 
-#if (__GNUC__ < 4 || __GNUC_MINOR__ < 7)
+#include "./MicroTrace.h"
+#include "./MicroPerf.h"
+#include "./MicroMemory.h"
+
+#if (__GNUC__ < 4 || (__GNUC__ == 4 && __GNUC_MINOR__ < 7))
 typedef std::chrono::monotonic_clock MicroBenchClock;
 #else
 typedef std::chrono::steady_clock MicroBenchClock;
@@ -16,13 +20,19 @@ typedef std::chrono::steady_clock MicroBenchClock;
 #define MICROBENCH_REPORT(start, end, os, fmt, units)\
   fprintf(os, fmt, std::chrono::duration_cast<units>(end - start).count())
 
+#ifndef MICROPROF_STREAM
 #define MICROPROF_STREAM stdout
+#endif
 typedef std::chrono::duration<double, std::milli> MicroProfUnits;
 
 #ifdef MICROPROF_ENABLE
 #define MICROPROF_TIMEPOINT(name) MICROBENCH_TIMEPOINT(name)
-#define MICROPROF_START(name) MICROPROF_TIMEPOINT(name ## _start)
+#define MICROPROF_START(name)\
+  MICROPROF_TIMEPOINT(name ## _start); MICROTRACE_BEGIN(name);\
+  MICROPERF_BEGIN(name)
 #define MICROPROF_END(name)\
+  MICROPERF_END(name);\
+  MICROTRACE_END(name);\
   MICROBENCH_TIMEPOINT(name ## _end);\
   MICROBENCH_REPORT(name ## _start, name ## _end, MICROPROF_STREAM, \
       "PROFILING:\t" #name "\t%.3f\n", MicroProfUnits)
@@ -32,8 +42,10 @@ typedef std::chrono::duration<double, std::milli> MicroProfUnits;
   fprintf(MICROPROF_STREAM, __VA_ARGS__); fflush(MICROPROF_STREAM)
 #else
 #define MICROPROF_TIMEPOINT(name)
-#define MICROPROF_START(name)
-#define MICROPROF_END(name)
+/* Spans are traced and counted in every build unless NO_TRACE or NO_PERF is
+ * defined. */
+#define MICROPROF_START(name) MICROTRACE_BEGIN(name); MICROPERF_BEGIN(name)
+#define MICROPROF_END(name) MICROPERF_END(name); MICROTRACE_END(name)
 #define MICROPROF_WARN(cond, warn)
 #define MICROPROF_INFO(...)
 #endif
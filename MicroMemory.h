@@ -0,0 +1,122 @@
+/** @author Mateusz Machalica */
+#ifndef MICROMEMORY_H_
+#define MICROMEMORY_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+/** Peak and current resident memory of the process over a scope, read from
+ * /proc/self/status. The kernel peak is reset when a scope begins (through
+ * /proc/self/clear_refs), peaks of nested scopes are carried over to the
+ * enclosing ones. Scopes should not overlap in time unless nested, as the
+ * peak belongs to the whole process. */
+class MicroMemory {
+  public:
+    struct Sample {
+      bool valid_;
+      /* Peak of the enclosing scope before this one began. */
+      int64_t outer_;
+    };
+
+    static inline void enable() {
+      enabled().store(true, std::memory_order_relaxed);
+    }
+
+    static inline bool on() {
+      return enabled().load(std::memory_order_relaxed);
+    }
+
+    /** Invalid sample if accounting is off. */
+    static inline Sample begin() {
+      Sample sample;
+      sample.valid_ = on();
+      if (sample.valid_) {
+        std::lock_guard<std::mutex> lock(mutex());
+        sample.outer_ = std::max(carried(), status("VmHWM:"));
+        carried() = 0;
+        reset_peak();
+      }
+      return sample;
+    }
+
+    /** Writes peak and resident bytes of the scope as a single line tagged
+     * with tag. */
+    static inline void report(FILE* os, const char* tag, const Sample& start) {
+      if (!start.valid_) {
+        return;
+      }
+      int64_t peak, resident;
+      {
+        std::lock_guard<std::mutex> lock(mutex());
+        peak = std::max(carried(), status("VmHWM:"));
+        resident = status("VmRSS:");
+        carried() = std::max(start.outer_, peak);
+      }
+      fprintf(os, "MEMORY:\t%s\tpeak=%lld\tresident=%lld\n", tag,
+          static_cast<long long>(peak), static_cast<long long>(resident));
+    }
+
+  private:
+    /* Bytes of a kB field of /proc/self/status, -1 if missing. */
+    static inline int64_t status(const char* field) {
+      FILE* fp = fopen("/proc/self/status", "r");
+      if (!fp) {
+        return -1;
+      }
+      const size_t len = strlen(field);
+      char line[256];
+      long long kbytes = -1;
+      while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, field, len) == 0 &&
+            sscanf(line + len, "%lld", &kbytes) == 1) {
+          break;
+        }
+      }
+      fclose(fp);
+      return kbytes < 0 ? -1 : static_cast<int64_t>(kbytes) * 1024;
+    }
+
+    static inline void reset_peak() {
+      FILE* fp = fopen("/proc/self/clear_refs", "w");
+      bool ok = fp && fputs("5", fp) >= 0;
+      if (fp) {
+        ok = fclose(fp) == 0 && ok;
+      }
+      static std::atomic<bool> warned(false);
+      if (!ok && !warned.exchange(true)) {
+        fprintf(stderr, "Peak memory cannot be reset, scopes report the peak "
+            "of the process.\n");
+      }
+    }
+
+    static inline std::atomic<bool>& enabled() {
+      static std::atomic<bool> flag(false);
+      return flag;
+    }
+
+    static inline std::mutex& mutex() {
+      static std::mutex lock;
+      return lock;
+    }
+
+    static inline int64_t& carried() {
+      static int64_t peak = 0;
+      return peak;
+    }
+};
+
+#ifndef NO_MEMORY_REPORT
+#define MICROMEM_BEGIN(name)\
+  const MicroMemory::Sample name ## _memory = MicroMemory::begin()
+#define MICROMEM_END(name)\
+  MicroMemory::report(MICROPROF_STREAM, #name, name ## _memory)
+#else
+#define MICROMEM_BEGIN(name)
+#define MICROMEM_END(name)
+#endif
+
+#endif  // MICROMEMORY_H_
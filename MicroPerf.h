@@ -0,0 +1,162 @@
+/** @author Mateusz Machalica */
+#ifndef MICROPERF_H_
+#define MICROPERF_H_
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+/** Hardware counters of the calling thread read through perf_event_open.
+ * Counters are opened lazily in every thread which reads them, those which
+ * the kernel or hardware refuses are reported as missing. Values are scaled
+ * when the kernel multiplexes counters. */
+class MicroPerf {
+  public:
+    static const int kCounters = 5;
+
+    struct Sample {
+      bool valid_;
+      int64_t values_[kCounters];
+    };
+
+    static inline void enable() {
+      enabled().store(true, std::memory_order_relaxed);
+    }
+
+    static inline bool on() {
+      return enabled().load(std::memory_order_relaxed);
+    }
+
+    /** Invalid sample if counting is off. */
+    static inline Sample read() {
+      Sample sample;
+      sample.valid_ = on();
+      if (sample.valid_) {
+        Counters& own = counters();
+        for (int c = 0; c < kCounters; c++) {
+          sample.values_[c] = own.read(c);
+        }
+      }
+      return sample;
+    }
+
+    /** Writes counts since start as a single line tagged with tag. */
+    static inline void report(FILE* os, const char* tag, const Sample& start) {
+      if (!start.valid_) {
+        return;
+      }
+      const Sample end = read();
+      char line[512];
+      int len = snprintf(line, sizeof(line), "PERF:\t%s", tag);
+      for (int c = 0; c < kCounters; c++) {
+        if (start.values_[c] < 0 || end.values_[c] < 0) {
+          len += snprintf(line + len, sizeof(line) - len, "\t%s=-", name(c));
+        } else {
+          len += snprintf(line + len, sizeof(line) - len, "\t%s=%lld",
+              name(c), static_cast<long long>(
+                end.values_[c] - start.values_[c]));
+        }
+      }
+      const int64_t cycles = end.values_[0] - start.values_[0],
+            instructions = end.values_[1] - start.values_[1];
+      if (start.values_[0] >= 0 && start.values_[1] >= 0 && cycles > 0) {
+        len += snprintf(line + len, sizeof(line) - len, "\tipc=%.3f",
+            static_cast<double>(instructions) / cycles);
+      }
+      fprintf(os, "%s\n", line);
+    }
+
+  private:
+    static inline const char* name(int c) {
+      static const char* const names[kCounters] = { "cycles",
+        "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+      return names[c];
+    }
+
+    struct Counters {
+      int fds_[kCounters];
+
+      Counters() {
+        const uint32_t types[kCounters] = { PERF_TYPE_HARDWARE,
+          PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE,
+          PERF_TYPE_HARDWARE };
+        const uint64_t configs[kCounters] = {
+          PERF_COUNT_HW_CPU_CYCLES,
+          PERF_COUNT_HW_INSTRUCTIONS,
+          PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+          PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+          PERF_COUNT_HW_BRANCH_MISSES };
+        bool missing = false;
+        for (int c = 0; c < kCounters; c++) {
+          perf_event_attr attr;
+          memset(&attr, 0, sizeof(attr));
+          attr.size = sizeof(attr);
+          attr.type = types[c];
+          attr.config = configs[c];
+          attr.exclude_kernel = 1;
+          attr.exclude_hv = 1;
+          attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+          fds_[c] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+          missing |= fds_[c] < 0;
+        }
+        static std::atomic<bool> warned(false);
+        if (missing && !warned.exchange(true)) {
+          fprintf(stderr, "Some hardware counters are unavailable.\n");
+        }
+      }
+
+      ~Counters() {
+        for (int c = 0; c < kCounters; c++) {
+          if (fds_[c] >= 0) {
+            close(fds_[c]);
+          }
+        }
+      }
+
+      Counters(const Counters&) = delete;
+      Counters& operator=(const Counters&) = delete;
+
+      inline int64_t read(int c) const {
+        uint64_t buf[3];
+        if (fds_[c] < 0 || ::read(fds_[c], buf, sizeof(buf)) !=
+            sizeof(buf)) {
+          return -1;
+        }
+        if (buf[2] == 0) {
+          return 0;
+        }
+        return static_cast<int64_t>(static_cast<double>(buf[0]) * buf[1] /
+            buf[2]);
+      }
+    };
+
+    static inline std::atomic<bool>& enabled() {
+      static std::atomic<bool> flag(false);
+      return flag;
+    }
+
+    static inline Counters& counters() {
+      static thread_local Counters own;
+      return own;
+    }
+};
+
+#ifndef NO_PERF
+#define MICROPERF_BEGIN(name)\
+  const MicroPerf::Sample name ## _perf = MicroPerf::read()
+#define MICROPERF_END(name)\
+  MicroPerf::report(MICROPROF_STREAM, #name, name ## _perf)
+#else
+#define MICROPERF_BEGIN(name)
+#define MICROPERF_END(name)
+#endif
+
+#endif  // MICROPERF_H_
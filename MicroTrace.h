@@ -0,0 +1,172 @@
+/** @author Mateusz Machalica */
+#ifndef MICROTRACE_H_
+#define MICROTRACE_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+/** Records spans and counters of every thread into per-thread buffers and
+ * exports them in Chrome trace format (chrome://tracing, ui.perfetto.dev).
+ * Tracing is off until enabled, then recording an event costs a clock read
+ * and an append to a buffer owned by the calling thread. */
+class MicroTrace {
+  public:
+    /* Device events are shown as a separate thread. */
+    static const int kDeviceTid = 1000;
+
+    struct Event {
+      const char* name_;
+      char phase_;
+      int tid_;
+      int64_t ts_;
+      int64_t dur_;
+      double value_;
+    };
+
+    static inline void enable() {
+      epoch();
+      enabled().store(true, std::memory_order_relaxed);
+    }
+
+    static inline bool on() {
+      return enabled().load(std::memory_order_relaxed);
+    }
+
+    /** Nanoseconds since tracing was enabled. */
+    static inline int64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - epoch()).count();
+    }
+
+    /** Returns a token for end(), negative if tracing is off. */
+    static inline int64_t begin() {
+      return on() ? now() : -1;
+    }
+
+    /** Name must outlive the trace, string literals are fine. */
+    static inline void end(const char* name, const int64_t start) {
+      if (start >= 0) {
+        Buffer& buf = buffer();
+        buf.events_.push_back(Event{name, 'X', buf.tid_, start,
+            now() - start, 0});
+      }
+    }
+
+    /** Counters of the same name from different threads are drawn as
+     * separate series if per_thread is set. */
+    static inline void counter(
+        const char* name,
+        const double value,
+        const bool per_thread = false
+        ) {
+      if (on()) {
+        Buffer& buf = buffer();
+        buf.events_.push_back(Event{name, per_thread ? 'c' : 'C', buf.tid_,
+            now(), 0, value});
+      }
+    }
+
+    /** Span timed by a device clock in nanoseconds, the clock is aligned
+     * with ours on the first call, when the span has just ended. */
+    static inline void device(
+        const char* name,
+        const int64_t device_start,
+        const int64_t device_end
+        ) {
+      if (on()) {
+        static const int64_t offset = now() - device_end;
+        buffer().events_.push_back(Event{name, 'X', kDeviceTid,
+            device_start + offset, device_end - device_start, 0});
+      }
+    }
+
+    /** Must not race with recording threads. */
+    static inline bool dump(const char* path) {
+      FILE* fp = fopen(path, "w");
+      if (!fp) {
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(registry().mutex_);
+      fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+          "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d,"
+          " \"args\": {\"name\": \"OpenCL device\"}}", kDeviceTid);
+      for (auto& buf : registry().buffers_) {
+        for (auto& evt : buf.events_) {
+          if (evt.phase_ == 'X') {
+            fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", evt.name_,
+                evt.tid_, evt.ts_ / 1e3, evt.dur_ / 1e3);
+          } else {
+            char series[32] = "value";
+            if (evt.phase_ == 'c') {
+              snprintf(series, sizeof(series), "thread %d", evt.tid_);
+            }
+            fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, "
+                "\"tid\": %d, \"ts\": %.3f, \"args\": {\"%s\": %g}}",
+                evt.name_, evt.tid_, evt.ts_ / 1e3, series, evt.value_);
+          }
+        }
+      }
+      fprintf(fp, "\n]}\n");
+      fclose(fp);
+      return true;
+    }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Buffer {
+      int tid_;
+      std::vector<Event> events_;
+    };
+
+    /* Buffers outlive threads which filled them. */
+    struct Registry {
+      std::mutex mutex_;
+      std::deque<Buffer> buffers_;
+    };
+
+    static inline std::atomic<bool>& enabled() {
+      static std::atomic<bool> flag(false);
+      return flag;
+    }
+
+    static inline Clock::time_point epoch() {
+      static const Clock::time_point start = Clock::now();
+      return start;
+    }
+
+    static inline Registry& registry() {
+      static Registry reg;
+      return reg;
+    }
+
+    static inline Buffer& buffer() {
+      static thread_local Buffer* own = nullptr;
+      if (!own) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex_);
+        reg.buffers_.push_back(Buffer());
+        own = &reg.buffers_.back();
+        own->tid_ = reg.buffers_.size();
+        own->events_.reserve(1 << 12);
+      }
+      return *own;
+    }
+};
+
+#ifndef NO_TRACE
+#define MICROTRACE_BEGIN(name)\
+  const int64_t name ## _trace = MicroTrace::begin()
+#define MICROTRACE_END(name) MicroTrace::end(#name, name ## _trace)
+#else
+#define MICROTRACE_BEGIN(name)
+#define MICROTRACE_END(name)
+#endif
+
+#endif  // MICROTRACE_H_
@@ -68,7 +68,7 @@ namespace mycl {
     return cl::Context(CL_DEVICE_TYPE_GPU, cps);
   }
 
-  Accelerator init_device() {
+  inline Accelerator init_device() {
     Accelerator acc;
     MICROPROF_START(init_device);
     acc.context_ = nvidia_context();
@@ -97,8 +97,13 @@ namespace mycl_debug {
   using mycl::bytes;
 
   inline cl_long duration(const cl::Event& evt) {
-    return evt.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
-      evt.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    const cl_long start = evt.getProfilingInfo<CL_PROFILING_COMMAND_START>(),
+          end = evt.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+#ifndef NO_TRACE
+    MicroTrace::device(evt.getInfo<CL_EVENT_COMMAND_TYPE>() ==
+        CL_COMMAND_NDRANGE_KERNEL ? "kernel" : "transfer", start, end);
+#endif
+    return end - start;
   }
 
   template<typename Iterator>